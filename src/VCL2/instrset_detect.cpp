@@ -162,6 +162,14 @@ bool hasAVX512VBMI2(void) {
     return ((abcd[2] & (1 << 6)) != 0);                    // ecx bit 6 indicates AVX512VBMI2
 }
 
+// detect if CPU supports the AVX512FP16 instruction set (also enumerated by AVX10)
+bool hasAVX512FP16(void) {
+    if (instrset_detect() < 10) return false;              // must have AVX512BW
+    int abcd[4];                                           // cpuid results
+    cpuid(abcd, 7);                                        // call cpuid function 7
+    return ((abcd[3] & (1 << 23)) != 0);                   // edx bit 23 indicates AVX512FP16
+}
+
 #ifdef VCL_NAMESPACE
 }
 #endif
@@ -1,235 +1,373 @@
+#include <chrono>
+#include <numeric>
+#include <optional>
+
 #include "grayworld_avs.h"
 
-template <grayworld_mode mode>
-static void convert_frame_c(float* __restrict tmpplab, PVideoFrame& src, float* line_sum, int* line_count_pels, const int pitch, const int width, const int height) noexcept
+static void unpack_alpha(const uint8_t* srcp, const ptrdiff_t src_pitch, float* dstp, const ptrdiff_t dst_pitch, const grayworld_input input, const int width, const int height) noexcept
 {
-    const float* r{ reinterpret_cast<const float*>(src->GetReadPtr(PLANAR_R)) };
-    const float* g{ reinterpret_cast<const float*>(src->GetReadPtr(PLANAR_G)) };
-    const float* b{ reinterpret_cast<const float*>(src->GetReadPtr(PLANAR_B)) };
-
-    float rgb[3];
-    float lab[3];
-
     for (int y{ 0 }; y < height; ++y)
     {
-        float* acur{ tmpplab + y * width + width * height };
-        float* bcur{ tmpplab + y * width + 2 * width * height };
-        float* lcur{ tmpplab + y * width };
-
-        if constexpr (mode == grayworld_mode::mean)
+        if (input == grayworld_input::rgb32)
         {
-            line_sum[y] = 0.0f;
-            line_sum[y + height] = 0.0f;
-            line_count_pels[y] = 0;
-
             for (int x{ 0 }; x < width; ++x)
-            {
-                rgb[0] = r[x];
-                rgb[1] = g[x];
-                rgb[2] = b[x];
-
-                rgb2lab_c(rgb, lab);
-
-                *(lcur++) = lab[0];
-                *(acur++) = lab[1];
-                *(bcur++) = lab[2];
-
-                line_sum[y] += lab[1];
-                line_sum[y + height] += lab[2];
-                line_count_pels[y]++;
-            }
+                dstp[x] = srcp[x * 4 + 3] * (1.0f / 255.0f);
         }
         else
         {
-            std::vector<float> m0;
-            m0.reserve(width);
-            std::vector<float> m1;
-            m1.reserve(width);
+            const uint16_t* s{ reinterpret_cast<const uint16_t*>(srcp) };
 
             for (int x{ 0 }; x < width; ++x)
-            {
-                rgb[0] = r[x];
-                rgb[1] = g[x];
-                rgb[2] = b[x];
+                dstp[x] = s[x * 4 + 3] * (1.0f / 65535.0f);
+        }
 
-                rgb2lab_c(rgb, lab);
+        srcp += src_pitch;
+        dstp += dst_pitch;
+    }
+}
 
-                *(lcur++) = lab[0];
-                *(acur++) = lab[1];
-                *(bcur++) = lab[2];
+// Frames whose size differs from the clip cache the scratch of this many sizes.
+static constexpr size_t scratch_sizes{ 4 };
 
-                m0.emplace_back(lab[1]);
-                m1.emplace_back(lab[2]);
-            }
+static constexpr int yuv_planes[3]{ PLANAR_Y, PLANAR_U, PLANAR_V };
+static constexpr int rgb_planes[3]{ PLANAR_R, PLANAR_G, PLANAR_B };
 
-            const auto middleItr{ m0.begin() + m0.size() / 2 };
-            std::nth_element(m0.begin(), middleItr, m0.end());
-            line_sum[y] = (m0.size() % 2 == 0) ? ((*(std::max_element(m0.begin(), middleItr)) + *middleItr) / 2) : *middleItr;
+static void source_planes(const PVideoFrame& src, const grayworld_input input, const int height, const uint8_t* srcp[3], ptrdiff_t src_pitch[3]) noexcept
+{
+    if (input == grayworld_input::rgb24 || input == grayworld_input::rgb32 || input == grayworld_input::rgb48 || input == grayworld_input::rgb64)
+    {
+        // packed RGB is stored bottom-up
+        src_pitch[0] = -static_cast<ptrdiff_t>(src->GetPitch());
+        srcp[0] = src->GetReadPtr() - (height - 1) * src_pitch[0];
+        return;
+    }
 
-            const auto middleItr1{ m1.begin() + m1.size() / 2 };
-            std::nth_element(m1.begin(), middleItr1, m1.end());
-            line_sum[y + height] = (m1.size() % 2 == 0) ? ((*(std::max_element(m1.begin(), middleItr1)) + *middleItr1) / 2) : *middleItr1;
-        }
+    for (int i{ 0 }; i < 3; ++i)
+    {
+        const int plane{ (input == grayworld_input::yuv) ? yuv_planes[i] : rgb_planes[i] };
 
-        r += pitch;
-        g += pitch;
-        b += pitch;
+        srcp[i] = src->GetReadPtr(plane);
+        src_pitch[i] = src->GetPitch(plane);
     }
 }
 
-static void correct_frame_c(PVideoFrame& dst, float* tmpplab, std::pair<float, float>& avg, const int pitch, const int width, const int height) noexcept
+grayworld::grayworld(PClip _child, int opt, grayworld_mode mode, int matrix, int transfer, bool debug, int tile, int layout, bool hugepages, int scratch_precision, bool stream,
+    int prefetch, int latency, int threads, IScriptEnvironment* env)
+    : GenericVideoFilter(_child), mode(mode), yuv(), tile(0), latency(latency), src_pixel_bytes(0), in_place(false)
 {
-    float* __restrict r{ reinterpret_cast<float*>(dst->GetWritePtr(PLANAR_R)) };
-    float* __restrict g{ reinterpret_cast<float*>(dst->GetWritePtr(PLANAR_G)) };
-    float* __restrict b{ reinterpret_cast<float*>(dst->GetWritePtr(PLANAR_B)) };
-
-    float rgb[3];
-    float lab[3];
+    if (vi.IsRGB24())
+        input = grayworld_input::rgb24;
+    else if (vi.IsRGB32())
+        input = grayworld_input::rgb32;
+    else if (vi.IsRGB48())
+        input = grayworld_input::rgb48;
+    else if (vi.IsRGB64())
+        input = grayworld_input::rgb64;
+    else if (vi.IsRGB() && vi.IsPlanar() && vi.ComponentSize() == 4)
+        input = grayworld_input::planar;
+    else if (vi.IsYUV() && vi.IsPlanar() && !vi.IsY())
+        input = grayworld_input::yuv;
+    else
+        env->ThrowError("grayworld: clip must be in RGB 32-bit planar format, RGB24/RGB32/RGB48/RGB64 or YUV planar format.");
+    if (matrix != 1 && matrix != 9)
+        env->ThrowError("grayworld: matrix must be either 1 or 9.");
+    if (transfer != 1 && transfer != 6 && transfer != 14 && transfer != 15 && transfer != 16)
+        env->ThrowError("grayworld: transfer must be 1, 6, 14, 15 or 16.");
 
-    for (int y{ 0 }; y < height; ++y)
+    if (input == grayworld_input::yuv)
     {
-        float* lcur{ tmpplab + y * width };
-        float* acur{ tmpplab + y * width + width * height };
-        float* bcur{ tmpplab + y * width + 2 * width * height };
+        yuv.kr = (matrix == 1) ? 0.2126f : 0.2627f;
+        yuv.kb = (matrix == 1) ? 0.0722f : 0.0593f;
+        yuv.transfer = (transfer == 16) ? grayworld_transfer::pq : grayworld_transfer::bt709;
+        yuv.ss_w = vi.GetPlaneWidthSubsampling(PLANAR_U);
+        yuv.ss_h = vi.GetPlaneHeightSubsampling(PLANAR_U);
+        yuv.bits = vi.BitsPerComponent();
+
+        if (yuv.ss_w > 1 || yuv.ss_h > 1)
+            env->ThrowError("grayworld: YUV clip must be 4:4:4, 4:2:2 or 4:2:0.");
+    }
+    if (opt < -1 || opt > 4)
+        env->ThrowError("grayworld: opt must be between -1..4.");
+    if (tile < -1)
+        env->ThrowError("grayworld: tile must be greater than or equal to -1.");
+    if (layout < 0 || layout > 1)
+        env->ThrowError("grayworld: layout must be either 0 or 1.");
+    if (scratch_precision < 0 || scratch_precision > 1)
+        env->ThrowError("grayworld: scratch_precision must be either 0 or 1.");
+    if (prefetch < -1)
+        env->ThrowError("grayworld: prefetch must be greater than or equal to -1.");
+    if (latency < 0 || latency > 1)
+        env->ThrowError("grayworld: latency must be either 0 or 1.");
+    if (threads < 0)
+        env->ThrowError("grayworld: threads must be greater than or equal to 0.");
+
+    const bool fp16{ scratch_precision == 1 };
+
+    // the CPU flags of the environment honor SetMaxCPU(), AviSynth has no flag for AVX512FP16
+    const int flags{ env->GetCPUFlags() };
+    grayworld_cpu cpu{ grayworld_cpu_features() };
+    cpu.sse2 = cpu.sse2 && (flags & CPUF_SSE2);
+    cpu.avx2 = cpu.avx2 && (flags & CPUF_AVX2);
+    cpu.f16c = cpu.f16c && (flags & CPUF_F16C);
+    cpu.avx512 = cpu.avx512 && (flags & CPUF_AVX512F);
+    cpu.avx512fp16 = cpu.avx512fp16 && cpu.avx512;
+
+    if (opt == 4 && !grayworld_supports(cpu, 4, fp16))
+        env->ThrowError("grayworld: opt=4 requires AVX512FP16.");
+    if (opt == 3 && !grayworld_supports(cpu, 3, fp16))
+        env->ThrowError("grayworld: opt=3 requires AVX512F.");
+    if (opt == 2 && !grayworld_supports(cpu, 2, fp16))
+        env->ThrowError("grayworld: opt=2 requires AVX2 (and F16C for scratch_precision=1).");
+    if (opt == 1 && !grayworld_supports(cpu, 1, fp16))
+        env->ThrowError("grayworld: opt=1 requires SSE2.");
 
-        for (int x{ 0 }; x < width; ++x)
-        {
-            lab[0] = *lcur++;
-            lab[1] = *acur++;
-            lab[2] = *bcur++;
-
-            // subtract the average for the color channels
-            lab[1] -= avg.first;
-            lab[2] -= avg.second;
-
-            //convert back to linear rgb
-            lab2rgb_c(lab, rgb);
-            r[x] = std::clamp(rgb[0], 0.0f, 1.0f);
-            g[x] = std::clamp(rgb[1], 0.0f, 1.0f);
-            b[x] = std::clamp(rgb[2], 0.0f, 1.0f);
-        }
+    const grayworld_layout lab_layout{ (layout == 0) ? grayworld_layout::planar : grayworld_layout::interleaved };
+    const grayworld_precision lab_precision{ (fp16) ? grayworld_precision::fp16 : grayworld_precision::fp32 };
 
-        r += pitch;
-        g += pitch;
-        b += pitch;
-    }
+    kernels = get_kernels(grayworld_dispatch(opt, cpu, fp16), mode, input, lab_layout, lab_precision, stream, prefetch);
+
+    // the shared pool is created by the first instance that uses it
+    if (threads != 1)
+        kernels.bands = (threads == 0) ? thread_pool::shared().size() : std::min(threads, thread_pool::shared().size());
+
+    stats.isa = kernels.isa;
+    stats.bands = kernels.bands;
+    stats.latency = latency;
+
+    src_pixel_bytes = (input == grayworld_input::rgb24) ? 3 : (input == grayworld_input::rgb32) ? 4 : (input == grayworld_input::rgb48) ? 6 :
+        (input == grayworld_input::rgb64) ? 8 : vi.ComponentSize();
+
+    // packed input is output as planar float
+    if (input == grayworld_input::rgb32 || input == grayworld_input::rgb64)
+        vi.pixel_type = VideoInfo::CS_RGBAPS;
+    else if (input != grayworld_input::planar && input != grayworld_input::yuv)
+        vi.pixel_type = VideoInfo::CS_RGBPS;
+
+    // latency=1 always works on strips, tile=0 selects the automatic strip height
+    this->tile = (tile != 0 || !latency) ? tile : -1;
+
+    // the output has the format of the input, the strips read the chroma rows above them with vertical subsampling
+    in_place = (input == grayworld_input::planar || input == grayworld_input::yuv) && (!this->tile || !yuv.ss_h);
+
+    scratch = std::make_unique<scratch_cache>(scratch_sizes, hugepages);
+
+    const int strip_height{ frame_strip_height(vi.width, vi.height, this->tile) };
+
+    // the first entry is allocated here to report the failure early
+    if (!acquire_scratch(vi.width, vi.height, strip_height))
+        env->ThrowError("grayworld: failed to allocate the scratch memory.");
+
+    stats.enabled = debug || grayworld_debug_env();
+    stats.add_scratch(scratch->bytes());
 }
 
-grayworld::grayworld(PClip _child, int opt, grayworld_mode mode, IScriptEnvironment* env)
-    : GenericVideoFilter(_child)
+scratch_pool::lease grayworld::acquire_scratch(const int width, const int height, const int strip_height) noexcept
 {
-    if (!vi.IsRGB() || !vi.IsPlanar() || vi.ComponentSize() != 4)
-        env->ThrowError("grayworld: clip must be in RGB 32-bit planar format.");
-    if (opt < -1 || opt > 3)
-        env->ThrowError("grayworld: opt must be between -1..3.");
+    return scratch->acquire(width, height, lab_scratch_size(kernels, width, (strip_height) ? strip_height * kernels.bands : height),
+        sizeof(float) * kernels.bands * row_scratch_size(kernels, input, width));
+}
 
-    const bool avx512{ !!(env->GetCPUFlags() & CPUF_AVX512F) };
-    if (!avx512 && opt == 3)
-        env->ThrowError("grayworld: opt=3 requires AVX512F.");
+grayworld_yuv grayworld::frame_yuv(const PVideoFrame& frame, IScriptEnvironment* env) const
+{
+    grayworld_yuv props_yuv{ yuv };
 
-    const bool avx2{ !!(env->GetCPUFlags() & CPUF_AVX2) };
-    if (!avx2 && opt == 2)
-        env->ThrowError("grayworld: opt=2 requires AVX2.");
+    if (input != grayworld_input::yuv)
+        return props_yuv;
 
-    const bool sse2{ !!(env->GetCPUFlags() & CPUF_SSE2) };
-    if (!sse2 && opt == 1)
-        env->ThrowError("grayworld: opt=1 requires SSE2.");
+    const AVSMap* props{ env->getFramePropsRO(frame) };
+    int err{ 0 };
 
-    if ((avx512 && opt < 0) || opt == 3)
-    {
-        if (mode == grayworld_mode::mean)
-        {
-            convert = convert_frame_avx512<grayworld_mode::mean>;
-            compute = compute_correction<grayworld_mode::mean>;
-        }
-        else
-        {
-            convert = convert_frame_avx512<grayworld_mode::median>;
-            compute = compute_correction<grayworld_mode::median>;
-        }
+    int64_t chroma_location{ env->propGetInt(props, "_ChromaLocation", 0, &err) };
+    if (err)
+        chroma_location = -1;
+
+    int64_t color_range{ env->propGetInt(props, "_ColorRange", 0, &err) };
+    if (err)
+        color_range = -1;
 
-        correct = correct_frame_avx512;
+    if (!grayworld_frame_yuv(props_yuv, chroma_location, color_range))
+        env->ThrowError("grayworld: the _ChromaLocation or _ColorRange of the frame isn't supported.");
+
+    return props_yuv;
+}
+
+grayworld::~grayworld()
+{
+    if (stats.enabled)
+        stats.dump();
+}
+
+PVideoFrame __stdcall grayworld::GetFrame(int n, IScriptEnvironment* env)
+{
+    const auto call_start{ std::chrono::steady_clock::now() };
+
+    PVideoFrame src{ child->GetFrame(n, env) };
+    // a frame whose size differs from the clip is processed (and output) with its own size
+    const int width{ src->GetRowSize() / src_pixel_bytes };
+    const int height{ src->GetHeight() };
+    const int strip_height{ frame_strip_height(width, height, tile) };
+    const grayworld_yuv src_yuv{ frame_yuv(src, env) };
+
+    // latency=1: the next frame waits for the offsets of this one instead of gathering them again
+    std::optional<offset_cache::in_flight> publish;
+    if (latency)
+        publish.emplace(offsets, n);
+
+    // the corrected frame is written back into the source when no one else holds it
+    const auto alloc_start{ std::chrono::steady_clock::now() };
+    const bool write_src{ in_place && src->IsWritable() };
+    PVideoFrame dst;
+
+    if (write_src)
+        dst = src;
+    else if (width == vi.width && height == vi.height)
+        dst = env->NewVideoFrameP(vi, &src);
+    else
+    {
+        VideoInfo frame_vi{ vi };
+        frame_vi.width = width;
+        frame_vi.height = height;
+        dst = env->NewVideoFrameP(frame_vi, &src);
     }
-    else if ((avx2 && opt < 0) || opt == 2)
+    const auto alloc_end{ std::chrono::steady_clock::now() };
+
+    const uint8_t* srcp[3];
+    ptrdiff_t src_pitch[3];
+    uint8_t* dstp[3];
+    ptrdiff_t dst_pitch[3];
+
+    source_planes(src, input, height, srcp, src_pitch);
+
+    for (int i{ 0 }; i < 3; ++i)
     {
-        if (mode == grayworld_mode::mean)
-        {
-            convert = convert_frame_avx2<grayworld_mode::mean>;
-            compute = compute_correction<grayworld_mode::mean>;
-        }
-        else
-        {
-            convert = convert_frame_avx2<grayworld_mode::median>;
-            compute = compute_correction<grayworld_mode::median>;
-        }
+        const int plane{ (input == grayworld_input::yuv) ? yuv_planes[i] : rgb_planes[i] };
 
-        correct = correct_frame_avx2;
+        dstp[i] = dst->GetWritePtr(plane);
+        dst_pitch[i] = dst->GetPitch(plane);
     }
-    else if ((sse2 && opt < 0) || opt == 1)
+
+    const scratch_pool::lease scratch{ acquire_scratch(width, height, strip_height) };
+    if (!scratch)
+        env->ThrowError("grayworld: failed to allocate the scratch memory.");
+
+    stats.add_scratch(this->scratch->bytes());
+
+    float* lab{ scratch->lab.get() };
+    float* line_sum{ scratch->line_sum.get() };
+    int* line_count_pels{ scratch->line_count_pels.get() };
+    float* rows{ scratch->rows.get() };
+
+    grayworld_stats::frame_scope frame{ stats };
+
+    std::pair<float, float> avg;
+    int64_t pixels;
+
+    const auto t0{ std::chrono::steady_clock::now() };
+    if (latency)
     {
-        if (mode == grayworld_mode::mean)
-        {
-            convert = convert_frame_sse2<grayworld_mode::mean>;
-            compute = compute_correction<grayworld_mode::mean>;
-        }
-        else
+        // frame n is corrected with the offsets of frame n - 1 (frame 0 with its own)
+        const int prev{ std::max(n - 1, 0) };
+        offset_cache::entry prev_offsets;
+        bool waited{ false };
+
+        // frame 0 uses its own offsets, a lookup would wait for itself
+        const bool cached{ prev != n && offsets.find(prev, prev_offsets, waited) };
+        stats.add_offset_lookup(waited, !cached);
+
+        // random access or the previous frame started after this one, its statistics are gathered again
+        if (!cached)
         {
-            convert = convert_frame_sse2<grayworld_mode::median>;
-            compute = compute_correction<grayworld_mode::median>;
+            const PVideoFrame prev_src{ (prev == n) ? src : child->GetFrame(prev, env) };
+            const int prev_width{ prev_src->GetRowSize() / src_pixel_bytes };
+            const int prev_height{ prev_src->GetHeight() };
+            const int prev_strip_height{ frame_strip_height(prev_width, prev_height, tile) };
+            const uint8_t* prevp[3];
+            ptrdiff_t prev_pitch[3];
+
+            // a previous frame of another size uses the scratch of its size
+            const bool same_size{ prev_width == width && prev_height == height };
+            const scratch_pool::lease prev_scratch{ (same_size) ? scratch_pool::lease(nullptr, nullptr) : acquire_scratch(prev_width, prev_height, prev_strip_height) };
+            if (!same_size && !prev_scratch)
+                env->ThrowError("grayworld: failed to allocate the scratch memory.");
+
+            float* prev_lab{ (same_size) ? lab : prev_scratch->lab.get() };
+            float* prev_line_sum{ (same_size) ? line_sum : prev_scratch->line_sum.get() };
+            int* prev_line_count_pels{ (same_size) ? line_count_pels : prev_scratch->line_count_pels.get() };
+            float* prev_rows{ (same_size) ? rows : prev_scratch->rows.get() };
+
+            source_planes(prev_src, input, prev_height, prevp, prev_pitch);
+            convert_frame_tiled(kernels, mode, input, frame_yuv(prev_src, env), prev_lab, prev_strip_height, prev_rows, prevp, prev_pitch, prev_line_sum,
+                prev_line_count_pels, prev_width, prev_height);
+            prev_offsets = { prev, kernels.compute(prev_line_sum, prev_line_count_pels, prev_height),
+                std::accumulate(prev_line_count_pels, prev_line_count_pels + prev_height, int64_t{ 0 }) };
+            offsets.insert(prev_offsets);
         }
 
-        correct = correct_frame_sse2;
+        avg = prev_offsets.avg;
+        pixels = prev_offsets.pixels;
     }
+    else if (strip_height)
+        convert_frame_tiled(kernels, mode, input, src_yuv, lab, strip_height, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
     else
+        convert_frame(kernels, mode, input, src_yuv, lab, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
+    const auto t1{ std::chrono::steady_clock::now() };
+    if (!latency)
     {
-        if (mode == grayworld_mode::mean)
-        {
-            convert = convert_frame_c<grayworld_mode::mean>;
-            compute = compute_correction<grayworld_mode::mean>;
-        }
-        else
-        {
-            convert = convert_frame_c<grayworld_mode::median>;
-            compute = compute_correction<grayworld_mode::median>;
-        }
-
-        correct = correct_frame_c;
+        avg = kernels.compute(line_sum, line_count_pels, height);
+        pixels = std::accumulate(line_count_pels, line_count_pels + height, int64_t{ 0 });
     }
+    const auto t2{ std::chrono::steady_clock::now() };
+    if (latency)
+        correct_frame_onepass(kernels, mode, input, src_yuv, lab, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+    else if (strip_height)
+        correct_frame_tiled(kernels, input, src_yuv, lab, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+    else
+        correct_frame(kernels, input, src_yuv, dstp, dst_pitch, lab, rows, avg, width, height);
+    const auto t3{ std::chrono::steady_clock::now() };
+    if (latency)
+        offsets.insert({ n, kernels.compute(line_sum, line_count_pels, height), std::accumulate(line_count_pels, line_count_pels + height, int64_t{ 0 }) });
+    const auto t4{ std::chrono::steady_clock::now() };
 
-    tmpplab = std::make_unique<float[]>(vi.height * vi.width * 3);
-    line_count_pels = std::make_unique<int[]>(vi.height);
-    line_sum = std::make_unique<float[]>(vi.height * 2);
-}
+    if (input == grayworld_input::planar || input == grayworld_input::yuv)
+    {
+        if (vi.NumComponents() == 4 && !write_src)
+            env->BitBlt(dst->GetWritePtr(PLANAR_A), dst->GetPitch(PLANAR_A), src->GetReadPtr(PLANAR_A), src->GetPitch(PLANAR_A), src->GetRowSize(PLANAR_A), height);
+    }
+    else if (input == grayworld_input::rgb32 || input == grayworld_input::rgb64)
+        unpack_alpha(srcp[0], src_pitch[0], reinterpret_cast<float*>(dst->GetWritePtr(PLANAR_A)), dst->GetPitch(PLANAR_A) / 4, input, width, height);
 
-PVideoFrame __stdcall grayworld::GetFrame(int n, IScriptEnvironment* env)
-{
-    PVideoFrame src{ child->GetFrame(n, env) };
-    PVideoFrame dst{ env->NewVideoFrameP(vi, &src) };
+    const int64_t convert_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() };
+    const int64_t compute_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1 + t4 - t3).count() };
+    const int64_t correct_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count() };
 
-    const int pitch{ src->GetPitch() };
-    const int dst_pitch{ dst->GetPitch() };
-    const int width{ src->GetRowSize() / 4 };
-    const int height{ src->GetHeight() };
+    frame.end(convert_ns, compute_ns, correct_ns);
 
-    convert(tmpplab.get(), src, line_sum.get(), line_count_pels.get(), pitch / 4, width, height);
-    avg = compute(line_sum.get(), line_count_pels.get(), height);
-    correct(dst, tmpplab.get(), avg, dst_pitch / 4, width, height);
+    AVSMap* props{ env->getFramePropsRW(dst) };
+    env->propSetFloat(props, "GrayworldA", avg.first, 0);
+    env->propSetFloat(props, "GrayworldB", avg.second, 0);
+    env->propSetInt(props, "GrayworldPixels", pixels, 0);
+    env->propSetInt(props, "GrayworldConvertNs", convert_ns, 0);
+    env->propSetInt(props, "GrayworldComputeNs", compute_ns, 0);
+    env->propSetInt(props, "GrayworldCorrectNs", correct_ns, 0);
 
-    if (vi.NumComponents() == 4)
-        env->BitBlt(dst->GetWritePtr(PLANAR_A), dst_pitch, src->GetReadPtr(PLANAR_A), pitch, src->GetRowSize(), height);
+    if (stats.enabled)
+        stats.add_host(std::chrono::duration_cast<std::chrono::nanoseconds>(alloc_end - alloc_start).count(),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - call_start).count());
 
     return dst;
 }
 
 AVSValue __cdecl Create_grayworld(AVSValue args, void* user_data, IScriptEnvironment* env)
 {
-    enum { CLIP, OPT, CC };
+    enum { CLIP, OPT, CC, MATRIX, TRANSFER, DEBUG, TILE, LAYOUT, HUGEPAGES, SCRATCH_PRECISION, STREAM, PREFETCH, LATENCY, THREADS };
 
     const int cc{ args[CC].AsInt(0) };
     if (cc < 0 || cc > 1)
         env->ThrowError("grayworld: cc must be either 0 or 1.");
 
-    return new grayworld(args[CLIP].AsClip(), args[OPT].AsInt(-1), (cc == 0) ? grayworld_mode::mean : grayworld_mode::median, env);
+    return new grayworld(args[CLIP].AsClip(), args[OPT].AsInt(-1), (cc == 0) ? grayworld_mode::mean : grayworld_mode::median, args[MATRIX].AsInt(1), args[TRANSFER].AsInt(1),
+        args[DEBUG].AsBool(false), args[TILE].AsInt(0), args[LAYOUT].AsInt(0), args[HUGEPAGES].AsBool(false), args[SCRATCH_PRECISION].AsInt(0), args[STREAM].AsBool(false),
+        args[PREFETCH].AsInt(-1), args[LATENCY].AsInt(0), args[THREADS].AsInt(1), env);
 }
 
 const AVS_Linkage* AVS_linkage;
@@ -239,7 +377,7 @@ const char* __stdcall AvisynthPluginInit3(IScriptEnvironment * env, const AVS_Li
 {
     AVS_linkage = vectors;
 
-    env->AddFunction("grayworld", "c[opt]i[cc]i", Create_grayworld, 0);
+    env->AddFunction("grayworld", "c[opt]i[cc]i[matrix]i[transfer]i[debug]b[tile]i[layout]i[hugepages]b[scratch_precision]i[stream]b[prefetch]i[latency]i[threads]i", Create_grayworld, 0);
 
     return "grayworld";
 }
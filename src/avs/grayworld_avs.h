@@ -4,38 +4,46 @@
 
 #include <avisynth.h>
 
-#include "../common/common.h"
-
-template <grayworld_mode mode>
-void convert_frame_sse2(float* __restrict tmpplab, PVideoFrame& src, float* line_sum, int* line_count_pels, const int pitch, const int width, const int height) noexcept;
-void correct_frame_sse2(PVideoFrame& dst, float* tmpplab, std::pair<float, float>& avg, const int pitch, const int width, const int height) noexcept;
-
-template <grayworld_mode mode>
-void convert_frame_avx2(float* __restrict tmpplab, PVideoFrame& src, float* line_sum, int* line_count_pels, const int pitch, const int width, const int height) noexcept;
-void correct_frame_avx2(PVideoFrame& dst, float* tmpplab, std::pair<float, float>& avg, const int pitch, const int width, const int height) noexcept;
-
-template <grayworld_mode mode>
-void convert_frame_avx512(float* __restrict tmpplab, PVideoFrame& src, float* line_sum, int* line_count_pels, const int pitch, const int width, const int height) noexcept;
-void correct_frame_avx512(PVideoFrame& dst, float* tmpplab, std::pair<float, float>& avg, const int pitch, const int width, const int height) noexcept;
+#include "../common/grayworld_core.h"
+#include "../common/offset_cache.h"
+#include "../common/scratch.h"
+#include "../common/stats.h"
+#include "../common/thread_pool.h"
 
 class grayworld : public GenericVideoFilter
 {
-    std::pair<float, float> avg;
-
-    std::unique_ptr<float[]>tmpplab;
-    std::unique_ptr<int[]>line_count_pels;
-    std::unique_ptr<float[]>line_sum;
-
-    void (*convert)(float* __restrict tmpplab, PVideoFrame& src, float* line_sum, int* line_count_pels, const int pitch, const int width, const int height) noexcept;
-    std::pair<float, float>(*compute)(float* line_sum, int* line_count_pels, const int height) noexcept;
-    void (*correct)(PVideoFrame& dst, float* tmpplab, std::pair<float, float>& avg, const int pitch, const int width, const int height) noexcept;
+    grayworld_mode mode;
+    grayworld_input input;
+    grayworld_yuv yuv;
+    grayworld_kernels kernels;
+    // the tile parameter, the strip height depends on the size of the frame
+    int tile;
+    int latency;
+    // the bytes of a pixel in the first plane of the source
+    int src_pixel_bytes;
+    // the source frame can be used as the output frame
+    bool in_place;
+
+    // the offsets of the last frames for latency=1
+    offset_cache offsets;
+
+    // one entry per frame in flight and frame size, the filter is shared by all threads
+    std::unique_ptr<scratch_cache> scratch;
+
+    scratch_pool::lease acquire_scratch(const int width, const int height, const int strip_height) noexcept;
+    // yuv with the _ChromaLocation and _ColorRange of frame
+    grayworld_yuv frame_yuv(const PVideoFrame& frame, IScriptEnvironment* env) const;
+
+    grayworld_stats stats;
 
 public:
-    grayworld(PClip _child, int opt, grayworld_mode mode, IScriptEnvironment* env);
+    grayworld(PClip _child, int opt, grayworld_mode mode, int matrix, int transfer, bool debug, int tile, int layout, bool hugepages, int scratch_precision, bool stream,
+        int prefetch, int latency, int threads, IScriptEnvironment* env);
+    ~grayworld();
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) override;
 
     int __stdcall SetCacheHints(int cachehints, int frame_range) override
     {
-        return cachehints == CACHE_GET_MTMODE ? MT_MULTI_INSTANCE : 0;
+        return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
     }
 };
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../cli/frame_io.h"
+#include "../common/scratch.h"
+#include "../common/thread_pool.h"
+
+using namespace std::literals;
+
+static constexpr char usage[]{
+    "Usage: grayworld-bench [options]\n"
+    "  Corrects synthetic frames with 1, 2, 4 .. threads threads and compares every output with the output of one thread.\n"
+    "  --format rgbs|yuv420|yuv444  planar float RGB or 10-bit YUV (default: rgbs)\n"
+    "  --width n --height n         frame size (default: 1920x1080)\n"
+    "  --frames n                   distinct frames (default: 8)\n"
+    "  --repeat n                   times every frame is corrected per run (default: 4)\n"
+    "  --threads n                  the largest thread count, 0: the size of the pool (default: 0)\n"
+    "  --cc 0|1                     0: mean, 1: median (default: 0)\n"
+    "  --opt -1..4                  cpu optimizations (default: -1)\n"
+    "  --tile n                     strip height, -1: auto, 0: full frame (default: 0)\n"
+    "  --latency 0|1                one pass with the offsets of the previous frame (default: 0)\n"
+};
+
+struct bench_options
+{
+    std::string format{ "rgbs" };
+    int width{ 1920 };
+    int height{ 1080 };
+    int frames{ 8 };
+    int repeat{ 4 };
+    int threads{ 0 };
+    int cc{ 0 };
+    int opt{ -1 };
+    int tile{ 0 };
+    int latency{ 0 };
+};
+
+// A synthetic source frame, its offsets (the input of latency=1 for the next frame) and the output of one thread.
+struct bench_frame
+{
+    frame_buffer src;
+    frame_buffer ref;
+    std::pair<float, float> offsets;
+    std::pair<float, float> ref_avg;
+};
+
+struct bench_context
+{
+    const bench_options& o;
+    grayworld_mode mode;
+    grayworld_input input;
+    grayworld_yuv yuv;
+    grayworld_kernels kernels;
+    int strip_height;
+    std::vector<bench_frame>& frames;
+    std::vector<frame_buffer>& outputs;
+    scratch_pool& pool;
+    std::atomic<int> next{ 0 };
+    std::atomic<int> mismatch{ -1 };
+    std::atomic<bool> failed_alloc{ false };
+};
+
+static bench_options parse_options(const int argc, char** argv)
+{
+    bench_options o;
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg{ argv[i] };
+
+        if (arg.size() <= 2 || arg.compare(0, 2, "--") != 0)
+            throw "unexpected argument "s + arg + "."s;
+        if (i + 1 >= argc)
+            throw arg + " requires a value."s;
+
+        const std::string value{ argv[++i] };
+
+        if (arg == "--format")
+        {
+            o.format = value;
+            continue;
+        }
+
+        char* end;
+        const long v{ std::strtol(value.c_str(), &end, 10) };
+        if (*end != '\0' || value.empty())
+            throw arg + " requires an integer."s;
+
+        const int n{ static_cast<int>(std::clamp<long>(v, -(1 << 30), 1 << 30)) };
+
+        if (arg == "--width")
+            o.width = n;
+        else if (arg == "--height")
+            o.height = n;
+        else if (arg == "--frames")
+            o.frames = n;
+        else if (arg == "--repeat")
+            o.repeat = n;
+        else if (arg == "--threads")
+            o.threads = n;
+        else if (arg == "--cc")
+            o.cc = n;
+        else if (arg == "--opt")
+            o.opt = n;
+        else if (arg == "--tile")
+            o.tile = n;
+        else if (arg == "--latency")
+            o.latency = n;
+        else
+            throw "unknown option "s + arg + "."s;
+    }
+
+    if (o.format != "rgbs" && o.format != "yuv420" && o.format != "yuv444")
+        throw "format must be rgbs, yuv420 or yuv444."s;
+    if (o.width <= 0 || o.height <= 0)
+        throw "width and height must be greater than 0."s;
+    if (o.frames <= 0 || o.repeat <= 0)
+        throw "frames and repeat must be greater than 0."s;
+    if (o.threads < 0)
+        throw "threads must be greater than or equal to 0."s;
+    if (o.cc < 0 || o.cc > 1)
+        throw "cc must be either 0 or 1."s;
+    if (o.opt < -1 || o.opt > 4)
+        throw "opt must be between -1..4."s;
+    if (o.tile < -1)
+        throw "tile must be greater than or equal to -1."s;
+    if (o.latency < 0 || o.latency > 1)
+        throw "latency must be either 0 or 1."s;
+
+    return o;
+}
+
+// Deterministic noise, every frame gets its own color cast so the offsets of the frames differ.
+static uint32_t hash(uint32_t x) noexcept
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+
+    return x;
+}
+
+static void fill_frame(frame_buffer& frame, const frame_info& info, const int index) noexcept
+{
+    const int chroma_width{ (info.width + info.yuv.ss_w) >> info.yuv.ss_w };
+    const int chroma_height{ (info.height + info.yuv.ss_h) >> info.yuv.ss_h };
+
+    for (int p{ 0 }; p < 3; ++p)
+    {
+        const int width{ (p && info.format == frame_format::y4m) ? chroma_width : info.width };
+        const int height{ (p && info.format == frame_format::y4m) ? chroma_height : info.height };
+        const float cast{ 0.03f * ((index * 3 + p) % 7 - 3) };
+
+        for (int y{ 0 }; y < height; ++y)
+        {
+            uint8_t* row{ frame.planes[p] + y * frame.pitch[p] };
+
+            for (int x{ 0 }; x < width; ++x)
+            {
+                const float noise{ (hash(static_cast<uint32_t>((index * 3 + p) * 0x9E3779B9u + y * 65537u + x)) & 0xFFFF) / 65535.0f };
+                // a gradient so the rows have different statistics
+                const float v{ std::clamp(0.25f + 0.5f * noise * (0.5f + 0.5f * y / height) + cast, 0.0f, 1.0f) };
+
+                if (info.format == frame_format::y4m)
+                {
+                    // limited range, the chroma centred at 512
+                    const uint16_t s{ static_cast<uint16_t>((p) ? 64 + (v - 0.5f) * 0.5f * 896 + 448 : 64 + v * 876) };
+                    std::memcpy(row + x * sizeof(s), &s, sizeof(s));
+                }
+                else
+                {
+                    std::memcpy(row + x * sizeof(v), &v, sizeof(v));
+                }
+            }
+        }
+    }
+}
+
+// Corrects frame index into dst and returns the offsets gathered from it.
+static std::pair<float, float> correct(const bench_context& c, const grayworld_kernels& k, const int index, frame_buffer& dst, const scratch_pool::lease& s) noexcept
+{
+    const bench_frame& frame{ c.frames[index] };
+    const int width{ c.o.width };
+    const int height{ c.o.height };
+    const uint8_t* const* srcp{ frame.src.planes };
+    float* line_sum{ s->line_sum.get() };
+    int* line_count_pels{ s->line_count_pels.get() };
+    float* rows{ s->rows.get() };
+
+    if (c.o.latency)
+    {
+        const std::pair<float, float>& avg{ c.frames[(index + c.frames.size() - 1) % c.frames.size()].offsets };
+        correct_frame_onepass(k, c.mode, c.input, c.yuv, s->lab.get(), c.strip_height, rows, srcp, frame.src.pitch, dst.planes, dst.pitch, avg, line_sum, line_count_pels, width, height);
+
+        return k.compute(line_sum, line_count_pels, height);
+    }
+
+    if (c.strip_height)
+        convert_frame_tiled(k, c.mode, c.input, c.yuv, s->lab.get(), c.strip_height, rows, srcp, frame.src.pitch, line_sum, line_count_pels, width, height);
+    else
+        convert_frame(k, c.mode, c.input, c.yuv, s->lab.get(), rows, srcp, frame.src.pitch, line_sum, line_count_pels, width, height);
+
+    const std::pair<float, float> avg{ k.compute(line_sum, line_count_pels, height) };
+
+    if (c.strip_height)
+        correct_frame_tiled(k, c.input, c.yuv, s->lab.get(), c.strip_height, rows, srcp, frame.src.pitch, dst.planes, dst.pitch, avg, line_sum, line_count_pels, width, height);
+    else
+        correct_frame(k, c.input, c.yuv, dst.planes, dst.pitch, s->lab.get(), rows, avg, width, height);
+
+    return avg;
+}
+
+static bool matches(const bench_frame& frame, const frame_buffer& dst, const std::pair<float, float>& avg) noexcept
+{
+    return !std::memcmp(dst.data.get(), frame.ref.data.get(), dst.size) && !std::memcmp(&avg, &frame.ref_avg, sizeof(avg));
+}
+
+// One task per thread, the tasks take the frames from a shared counter, every frame is corrected by one thread.
+static void frame_worker(void* ctx, const int i) noexcept
+{
+    bench_context& c{ *static_cast<bench_context*>(ctx) };
+    const int count{ static_cast<int>(c.frames.size()) * c.o.repeat };
+
+    for (int n{ c.next.fetch_add(1, std::memory_order_relaxed) }; n < count; n = c.next.fetch_add(1, std::memory_order_relaxed))
+    {
+        const scratch_pool::lease scratch{ c.pool.acquire() };
+        if (!scratch)
+        {
+            c.failed_alloc.store(true, std::memory_order_relaxed);
+            return;
+        }
+
+        const int index{ n % static_cast<int>(c.frames.size()) };
+        const std::pair<float, float> avg{ correct(c, c.kernels, index, c.outputs[i], scratch) };
+
+        if (!matches(c.frames[index], c.outputs[i], avg))
+        {
+            int expected{ -1 };
+            c.mismatch.compare_exchange_strong(expected, index, std::memory_order_relaxed);
+        }
+    }
+}
+
+static int run(const bench_options& o)
+{
+    const bool yuv{ o.format != "rgbs" };
+    const grayworld_mode mode{ (o.cc == 0) ? grayworld_mode::mean : grayworld_mode::median };
+    const grayworld_input input{ (yuv) ? grayworld_input::yuv : grayworld_input::planar };
+
+    if (o.opt >= 0 && !grayworld_supports(grayworld_cpu_features(), o.opt, false))
+        throw "opt="s + std::to_string(o.opt) + " is not supported by the CPU."s;
+
+    grayworld_kernels kernels{ get_kernels(grayworld_dispatch(o.opt, grayworld_cpu_features(), false), mode, input, grayworld_layout::planar, grayworld_precision::fp32, false, -1) };
+    kernels.bands = 1;
+
+    const int max_threads{ (o.threads == 0) ? thread_pool::shared().size() : std::min(o.threads, thread_pool::shared().size()) };
+
+    frame_info info{};
+    info.format = (yuv) ? frame_format::y4m : frame_format::rgbs;
+    info.width = o.width;
+    info.height = o.height;
+    info.yuv = { 0.2126f, 0.0722f, grayworld_transfer::bt709, (o.format == "yuv420") ? 1 : 0, (o.format == "yuv420") ? 1 : 0, (yuv) ? 10 : 32, 0, false };
+
+    // latency=1 always works on strips, tile=0 selects the automatic strip height
+    const int strip_height{ frame_strip_height(o.width, o.height, (o.latency && o.tile == 0) ? -1 : o.tile) };
+
+    // the strips and the row buffers of the row bands of the largest thread count
+    const size_t lab_size{ lab_scratch_size(kernels, o.width, (strip_height) ? strip_height * max_threads : o.height) };
+    scratch_pool pool{ lab_size, o.height, sizeof(float) * max_threads * row_scratch_size(kernels, input, o.width), false };
+
+    std::vector<bench_frame> frames(o.frames);
+    std::vector<frame_buffer> outputs(max_threads);
+
+    for (int i{ 0 }; i < o.frames; ++i)
+    {
+        frames[i].src.allocate(info);
+        frames[i].ref.allocate(info);
+        fill_frame(frames[i].src, info, i);
+    }
+
+    for (frame_buffer& output : outputs)
+        output.allocate(info);
+
+    bench_context c{ o, mode, input, info.yuv, kernels, strip_height, frames, outputs, pool };
+
+    {
+        const scratch_pool::lease scratch{ pool.acquire() };
+        if (!scratch)
+            throw "failed to allocate the scratch memory."s;
+
+        // the offsets of every frame (the input of latency=1), then the output of one thread
+        for (int i{ 0 }; i < o.frames; ++i)
+        {
+            if (strip_height)
+                convert_frame_tiled(kernels, mode, input, info.yuv, scratch->lab.get(), strip_height, scratch->rows.get(), frames[i].src.planes, frames[i].src.pitch,
+                    scratch->line_sum.get(), scratch->line_count_pels.get(), o.width, o.height);
+            else
+                convert_frame(kernels, mode, input, info.yuv, scratch->lab.get(), scratch->rows.get(), frames[i].src.planes, frames[i].src.pitch,
+                    scratch->line_sum.get(), scratch->line_count_pels.get(), o.width, o.height);
+            frames[i].offsets = kernels.compute(scratch->line_sum.get(), scratch->line_count_pels.get(), o.height);
+        }
+
+        for (int i{ 0 }; i < o.frames; ++i)
+            frames[i].ref_avg = correct(c, kernels, i, frames[i].ref, scratch);
+    }
+
+    std::fprintf(stderr, "grayworld-bench: %dx%d %s, cc=%d, tile=%d, latency=%d, %s, %d frames x %d, pool of %d threads\n", o.width, o.height, o.format.c_str(), o.cc, o.tile,
+        o.latency, kernels.isa, o.frames, o.repeat, thread_pool::shared().size());
+    std::fprintf(stdout, "threads  frames fps  efficiency  bands fps  efficiency\n");
+
+    const int count{ o.frames * o.repeat };
+    double frames_fps1{ 0.0 };
+    double bands_fps1{ 0.0 };
+    bool failed{ false };
+
+    for (int threads{ 1 };; threads = std::min(threads * 2, max_threads))
+    {
+        // frames: threads frames in flight with one band each (the host threads)
+        c.next.store(0);
+        c.mismatch.store(-1);
+
+        const auto t0{ std::chrono::steady_clock::now() };
+        thread_pool::shared().run(threads, frame_worker, &c);
+        const double frames_fps{ count / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() };
+
+        if (c.failed_alloc.load())
+            throw "failed to allocate the scratch memory."s;
+        if (c.mismatch.load() >= 0)
+        {
+            std::fprintf(stderr, "grayworld-bench: threads=%d (frames): frame %d differs from the output of one thread.\n", threads, c.mismatch.load());
+            failed = true;
+        }
+
+        // bands: one frame at a time split into threads row bands (parameter threads)
+        grayworld_kernels k{ kernels };
+        k.bands = threads;
+        int band_mismatch{ -1 };
+
+        const auto t1{ std::chrono::steady_clock::now() };
+        {
+            const scratch_pool::lease scratch{ pool.acquire() };
+            if (!scratch)
+                throw "failed to allocate the scratch memory."s;
+
+            for (int n{ 0 }; n < count; ++n)
+            {
+                const int index{ n % o.frames };
+                const std::pair<float, float> avg{ correct(c, k, index, outputs[0], scratch) };
+
+                if (band_mismatch < 0 && !matches(frames[index], outputs[0], avg))
+                    band_mismatch = index;
+            }
+        }
+        const double bands_fps{ count / std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count() };
+
+        if (band_mismatch >= 0)
+        {
+            std::fprintf(stderr, "grayworld-bench: threads=%d (bands): frame %d differs from the output of one thread.\n", threads, band_mismatch);
+            failed = true;
+        }
+
+        if (threads == 1)
+        {
+            frames_fps1 = frames_fps;
+            bands_fps1 = bands_fps;
+        }
+
+        // efficiency: the fps divided by threads times the fps of one thread
+        std::fprintf(stdout, "%7d  %10.1f  %10.2f  %9.1f  %10.2f\n", threads, frames_fps, frames_fps / (threads * frames_fps1), bands_fps, bands_fps / (threads * bands_fps1));
+        std::fflush(stdout);
+
+        if (threads == max_threads)
+            break;
+    }
+
+    return (failed) ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && (!std::strcmp(argv[1], "--help") || !std::strcmp(argv[1], "-h")))
+    {
+        std::fputs(usage, stderr);
+        return 0;
+    }
+
+    try
+    {
+        return run(parse_options(argc, argv));
+    }
+    catch (const std::string& error)
+    {
+        std::fprintf(stderr, "grayworld-bench: %s\n", error.c_str());
+        return 1;
+    }
+}
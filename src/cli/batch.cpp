@@ -0,0 +1,428 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+
+#include "cli.h"
+#include "frame_io.h"
+#include "mapped_file.h"
+#include "work_queue.h"
+#include "../common/scratch.h"
+#include "../common/stats.h"
+#include "../common/thread_pool.h"
+
+using namespace std::literals;
+
+struct batch_image
+{
+    std::string path;
+    std::string output;
+    frame_format format;
+    mapped_file input;
+};
+
+// The memory of one worker, it grows to the largest image and is reused for the next ones.
+struct batch_scratch
+{
+    scratch_ptr<float> lab;
+    size_t lab_size{ 0 };
+    // the row buffers of the core
+    scratch_ptr<float> row_buffers;
+    size_t row_buffers_size{ 0 };
+    std::unique_ptr<float[]> line_sum;
+    std::unique_ptr<int[]> line_count_pels;
+    int rows{ 0 };
+    // the planar float strip of the rgbh and pfm images and its row statistics,
+    // rgbs is processed from the input mapping into the output mapping
+    scratch_ptr<float> planes;
+    size_t planes_size{ 0 };
+    std::unique_ptr<float[]> strip_sum;
+    std::unique_ptr<int[]> strip_count_pels;
+    int strip_rows{ 0 };
+};
+
+struct batch_context
+{
+    const cli_options& o;
+    grayworld_mode mode;
+    grayworld_kernels kernels;
+    work_queue<batch_image>& images;
+    grayworld_stats& stats;
+    std::atomic<int64_t> done{ 0 };
+    std::atomic<int64_t> failed{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+template <typename T>
+static void reserve(scratch_ptr<T>& p, size_t& capacity, const size_t n)
+{
+    if (n <= capacity)
+        return;
+
+    p = scratch_alloc<T>(n, false);
+    capacity = (p) ? n : 0;
+
+    if (!p)
+        throw "failed to allocate the scratch memory."s;
+}
+
+// Converts the rows y..y+n of a rgbh or pfm image (pixels: the first pixel byte) to the planar float rows of planes.
+static void unpack_rows(const grayworld_kernels& k, const frame_format format, const uint8_t* pixels, const bool big_endian, const int width, const int height, const int y,
+    const int n, uint8_t* const planes[3], const ptrdiff_t pitch) noexcept
+{
+    const size_t plane{ static_cast<size_t>(width) * height };
+
+    for (int i{ 0 }; i < n; ++i)
+    {
+        float* r{ reinterpret_cast<float*>(planes[0] + i * pitch) };
+        float* g{ reinterpret_cast<float*>(planes[1] + i * pitch) };
+        float* b{ reinterpret_cast<float*>(planes[2] + i * pitch) };
+
+        if (format == frame_format::rgbh)
+        {
+            const uint16_t* half{ reinterpret_cast<const uint16_t*>(pixels) + static_cast<size_t>(y + i) * width };
+
+            k.half_to_float_row(half, r, width);
+            k.half_to_float_row(half + plane, g, width);
+            k.half_to_float_row(half + 2 * plane, b, width);
+            continue;
+        }
+
+        // the rows are stored bottom-up
+        const uint8_t* row{ pixels + (static_cast<size_t>(height) - 1 - y - i) * width * 3 * sizeof(float) };
+
+        for (int x{ 0 }; x < width; ++x)
+        {
+            uint8_t rgb[12];
+            std::memcpy(rgb, row + x * sizeof(rgb), sizeof(rgb));
+
+            if (big_endian)
+            {
+                for (int j{ 0 }; j < 12; j += 4)
+                {
+                    std::swap(rgb[j], rgb[j + 3]);
+                    std::swap(rgb[j + 1], rgb[j + 2]);
+                }
+            }
+
+            std::memcpy(&r[x], rgb, 4);
+            std::memcpy(&g[x], rgb + 4, 4);
+            std::memcpy(&b[x], rgb + 8, 4);
+        }
+    }
+}
+
+// The reverse of unpack_rows, pfm is written little endian.
+static void pack_rows(const grayworld_kernels& k, const frame_format format, uint8_t* pixels, const int width, const int height, const int y, const int n,
+    const uint8_t* const planes[3], const ptrdiff_t pitch) noexcept
+{
+    const size_t plane{ static_cast<size_t>(width) * height };
+
+    for (int i{ 0 }; i < n; ++i)
+    {
+        const float* r{ reinterpret_cast<const float*>(planes[0] + i * pitch) };
+        const float* g{ reinterpret_cast<const float*>(planes[1] + i * pitch) };
+        const float* b{ reinterpret_cast<const float*>(planes[2] + i * pitch) };
+
+        if (format == frame_format::rgbh)
+        {
+            uint16_t* half{ reinterpret_cast<uint16_t*>(pixels) + static_cast<size_t>(y + i) * width };
+
+            k.float_to_half_row(r, half, width);
+            k.float_to_half_row(g, half + plane, width);
+            k.float_to_half_row(b, half + 2 * plane, width);
+            continue;
+        }
+
+        // the pixels follow the header, they aren't aligned
+        uint8_t* row{ pixels + (static_cast<size_t>(height) - 1 - y - i) * width * 3 * sizeof(float) };
+
+        for (int x{ 0 }; x < width; ++x)
+        {
+            const float rgb[3]{ r[x], g[x], b[x] };
+            std::memcpy(row + x * sizeof(rgb), rgb, sizeof(rgb));
+        }
+    }
+}
+
+// Corrects the pixels of image (offset: the first pixel byte of the input) into out.
+static void correct_pixels(batch_context& c, batch_scratch& s, const batch_image& image, const int width, const int height, const size_t offset, const bool big_endian,
+    uint8_t* out)
+{
+    const grayworld_kernels& k{ c.kernels };
+    const uint8_t* data{ image.input.data() };
+    const size_t plane{ static_cast<size_t>(width) * height };
+    const ptrdiff_t pitch[3]{ static_cast<ptrdiff_t>(width) * 4, static_cast<ptrdiff_t>(width) * 4, static_cast<ptrdiff_t>(width) * 4 };
+    const int strip_height{ frame_strip_height(width, height, c.o.tile) };
+    const grayworld_yuv yuv{};
+
+    reserve(s.lab, s.lab_size, lab_scratch_size(k, width, (strip_height) ? strip_height : height));
+    reserve(s.row_buffers, s.row_buffers_size, row_scratch_size(k, grayworld_input::planar, width));
+
+    if (height > s.rows)
+    {
+        s.line_sum = std::make_unique<float[]>(height * 2);
+        s.line_count_pels = std::make_unique<int[]>(height);
+        s.rows = height;
+    }
+
+    float* line_sum{ s.line_sum.get() };
+    int* line_count_pels{ s.line_count_pels.get() };
+
+    grayworld_stats::frame_scope frame{ c.stats };
+
+    std::chrono::steady_clock::time_point t0, t1, t2, t3;
+
+    if (image.format == frame_format::rgbs)
+    {
+        const uint8_t* srcp[3];
+        uint8_t* dstp[3];
+
+        for (int i{ 0 }; i < 3; ++i)
+        {
+            srcp[i] = data + i * plane * sizeof(float);
+            dstp[i] = out + i * plane * sizeof(float);
+        }
+
+        t0 = std::chrono::steady_clock::now();
+        if (strip_height)
+            convert_frame_tiled(k, c.mode, grayworld_input::planar, yuv, s.lab.get(), strip_height, s.row_buffers.get(), srcp, pitch, line_sum, line_count_pels, width, height);
+        else
+            convert_frame(k, c.mode, grayworld_input::planar, yuv, s.lab.get(), s.row_buffers.get(), srcp, pitch, line_sum, line_count_pels, width, height);
+        t1 = std::chrono::steady_clock::now();
+        const std::pair<float, float> avg{ k.compute(line_sum, line_count_pels, height) };
+        t2 = std::chrono::steady_clock::now();
+        if (strip_height)
+            correct_frame_tiled(k, grayworld_input::planar, yuv, s.lab.get(), strip_height, s.row_buffers.get(), srcp, pitch, dstp, pitch, avg, line_sum, line_count_pels, width,
+                height);
+        else
+            correct_frame(k, grayworld_input::planar, yuv, dstp, pitch, s.lab.get(), s.row_buffers.get(), avg, width, height);
+        t3 = std::chrono::steady_clock::now();
+    }
+    else
+    {
+        // rgbh and pfm are converted to planar float strip by strip (the whole image without tile),
+        // every strip is a frame of its own whose row statistics are gathered into those of the image
+        const int rows{ (strip_height) ? strip_height : height };
+        const size_t strip_plane{ static_cast<size_t>(width) * rows };
+
+        reserve(s.planes, s.planes_size, strip_plane * 3);
+        if (rows > s.strip_rows)
+        {
+            s.strip_sum = std::make_unique<float[]>(rows * 2);
+            s.strip_count_pels = std::make_unique<int[]>(rows);
+            s.strip_rows = rows;
+        }
+
+        uint8_t* planes[3];
+        for (int i{ 0 }; i < 3; ++i)
+            planes[i] = reinterpret_cast<uint8_t*>(s.planes.get() + i * strip_plane);
+
+        const uint8_t* const* srcp{ planes };
+        float* strip_sum{ s.strip_sum.get() };
+        int* strip_count_pels{ s.strip_count_pels.get() };
+
+        t0 = std::chrono::steady_clock::now();
+        for (int y{ 0 }; y < height; y += rows)
+        {
+            const int n{ std::min(rows, height - y) };
+
+            unpack_rows(k, image.format, data + offset, big_endian, width, height, y, n, planes, pitch[0]);
+            convert_frame(k, c.mode, grayworld_input::planar, yuv, s.lab.get(), s.row_buffers.get(), srcp, pitch, strip_sum, strip_count_pels, width, n);
+
+            std::copy(strip_sum, strip_sum + n, line_sum + y);
+            std::copy(strip_sum + n, strip_sum + 2 * n, line_sum + height + y);
+            std::copy(strip_count_pels, strip_count_pels + n, line_count_pels + y);
+        }
+        t1 = std::chrono::steady_clock::now();
+        const std::pair<float, float> avg{ k.compute(line_sum, line_count_pels, height) };
+        t2 = std::chrono::steady_clock::now();
+        for (int y{ 0 }; y < height; y += rows)
+        {
+            const int n{ std::min(rows, height - y) };
+
+            // the full image is still in the scratch from the first pass
+            if (strip_height)
+            {
+                unpack_rows(k, image.format, data + offset, big_endian, width, height, y, n, planes, pitch[0]);
+                convert_frame(k, c.mode, grayworld_input::planar, yuv, s.lab.get(), s.row_buffers.get(), srcp, pitch, strip_sum, strip_count_pels, width, n);
+            }
+
+            correct_frame(k, grayworld_input::planar, yuv, planes, pitch, s.lab.get(), s.row_buffers.get(), avg, width, n);
+            pack_rows(k, image.format, out, width, height, y, n, planes, pitch[0]);
+        }
+        t3 = std::chrono::steady_clock::now();
+    }
+
+    frame.end(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(), std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count());
+}
+
+static void correct_image(batch_context& c, batch_scratch& s, const batch_image& image)
+{
+    const uint8_t* data{ image.input.data() };
+    const size_t size{ image.input.size() };
+
+    int width{ c.o.width };
+    int height{ c.o.height };
+    size_t offset{ 0 };
+    bool big_endian{ false };
+
+    if (image.format == frame_format::pfm)
+        offset = parse_pfm_header(data, size, width, height, big_endian);
+    else if (width <= 0 || height <= 0)
+        throw "width and height are required for raw input."s;
+
+    const size_t plane{ static_cast<size_t>(width) * height };
+    const size_t pixel_bytes{ plane * 3 * ((image.format == frame_format::rgbh) ? sizeof(uint16_t) : sizeof(float)) };
+
+    if (size - offset < pixel_bytes || (image.format != frame_format::pfm && size != pixel_bytes))
+        throw "the size of the file doesn't match the image size."s;
+
+    const std::string header{ (image.format == frame_format::pfm) ? "PF\n"s + std::to_string(width) + " "s + std::to_string(height) + "\n-1.0\n"s : ""s };
+    mapped_file output{ mapped_file::create(image.output, header.size() + pixel_bytes) };
+    std::memcpy(output.data(), header.data(), header.size());
+
+    try
+    {
+        correct_pixels(c, s, image, width, height, offset, big_endian, output.data() + header.size());
+    }
+    catch (const std::string&)
+    {
+        // a failed image leaves no output behind, the file is unmapped before it is removed
+        output = mapped_file{};
+        std::error_code ec;
+        std::filesystem::remove(image.output, ec);
+        throw;
+    }
+}
+
+static void batch_worker(void* ctx, const int) noexcept
+{
+    batch_context& c{ *static_cast<batch_context*>(ctx) };
+    batch_scratch s;
+
+    for (batch_image image; c.images.pop(image);)
+    {
+        try
+        {
+            correct_image(c, s, image);
+            c.done.fetch_add(1, std::memory_order_relaxed);
+            c.bytes.fetch_add(image.input.size(), std::memory_order_relaxed);
+        }
+        catch (const std::string& error)
+        {
+            std::fprintf(stderr, "grayworld-cli: %s: %s\n", image.path.c_str(), error.c_str());
+            c.failed.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // unmapped before the next image is taken
+        image.input = mapped_file{};
+    }
+}
+
+int run_batch(const cli_options& o)
+{
+    const grayworld_mode mode{ (o.cc == 0) ? grayworld_mode::mean : grayworld_mode::median };
+
+    if (o.opt >= 0 && !grayworld_supports(grayworld_cpu_features(), o.opt, false))
+        throw "opt="s + std::to_string(o.opt) + " is not supported by the CPU."s;
+
+    // the images run in parallel, every image is processed by one thread
+    grayworld_kernels kernels{ get_kernels(grayworld_dispatch(o.opt, grayworld_cpu_features(), false), mode, grayworld_input::planar, grayworld_layout::planar,
+        grayworld_precision::fp32, false, -1) };
+    kernels.bands = 1;
+
+    const int workers{ (o.threads == 0) ? thread_pool::shared().size() : std::min(o.threads, thread_pool::shared().size()) };
+
+    std::ifstream list_file;
+    if (o.input != "-")
+    {
+        list_file.open(o.input);
+        if (!list_file)
+            throw "failed to open "s + o.input + "."s;
+    }
+    std::istream& list{ (o.input == "-") ? std::cin : list_file };
+
+    std::error_code ec;
+    std::filesystem::create_directories(o.output, ec);
+    if (ec)
+        throw "failed to create "s + o.output + "."s;
+
+    grayworld_stats stats;
+    stats.enabled = o.debug || grayworld_debug_env();
+    stats.isa = kernels.isa;
+    stats.bands = kernels.bands;
+
+    // the mapped images wait here while the kernel reads them ahead
+    work_queue<batch_image> images{ static_cast<size_t>(workers) * 2 };
+    batch_context c{ o, mode, kernels, images, stats };
+    std::atomic<int64_t> rejected{ 0 };
+
+    const auto start{ std::chrono::steady_clock::now() };
+
+    std::thread producer{ [&]
+        {
+            std::set<std::string> outputs;
+
+            for (std::string path; std::getline(list, path);)
+            {
+                if (!path.empty() && path.back() == '\r')
+                    path.pop_back();
+                if (path.empty())
+                    continue;
+
+                try
+                {
+                    batch_image image;
+                    image.format = parse_frame_format(o.format, path);
+
+                    if (image.format == frame_format::y4m)
+                        throw "batch mode supports rgbs, rgbh and pfm."s;
+
+                    const std::filesystem::path output{ std::filesystem::path(o.output) / std::filesystem::path(path).filename() };
+                    if (std::filesystem::exists(output, ec) && std::filesystem::equivalent(output, path, ec))
+                        throw "the output would overwrite the input."s;
+                    // the outputs only keep the file name, images of different directories may share it
+                    if (!outputs.insert(output.lexically_normal().string()).second)
+                        throw "the output "s + output.string() + " is already written by an earlier image."s;
+
+                    image.path = path;
+                    image.output = output.string();
+                    image.input = mapped_file::open(path);
+
+                    if (!images.push(std::move(image)))
+                        break;
+                }
+                catch (const std::string& error)
+                {
+                    std::fprintf(stderr, "grayworld-cli: %s: %s\n", path.c_str(), error.c_str());
+                    rejected.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            images.close();
+        } };
+
+    thread_pool::shared().run(workers, batch_worker, &c);
+    producer.join();
+
+    const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+    const int64_t done{ c.done.load() };
+    const int64_t failed{ c.failed.load() + rejected.load() };
+
+    std::fprintf(stderr, "grayworld-cli: %lld images (%lld failed) in %.3f s, %.1f images/s, %.1f MiB/s read\n", static_cast<long long>(done), static_cast<long long>(failed),
+        seconds, (seconds > 0.0) ? done / seconds : 0.0, (seconds > 0.0) ? c.bytes.load() / seconds / (1024.0 * 1024.0) : 0.0);
+
+    if (stats.enabled)
+        stats.dump();
+
+    return (failed) ? 1 : 0;
+}
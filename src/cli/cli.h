@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+struct cli_options
+{
+    std::string input;
+    std::string output;
+    std::string format;
+    int width{ 0 };
+    int height{ 0 };
+    int cc{ 0 };
+    int opt{ -1 };
+    int matrix{ 1 };
+    int transfer{ 1 };
+    int tile{ 0 };
+    int threads{ 0 };
+    bool batch{ false };
+    bool debug{ false };
+};
+
+// --batch: input is a list of images (one path per line, - for stdin), output the directory of the corrected images.
+// The images are memory mapped and processed threads at a time (0: the size of the pool). Returns the exit code.
+int run_batch(const cli_options& o);
@@ -0,0 +1,416 @@
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "frame_io.h"
+
+using namespace std::literals;
+
+static void read_exact(std::FILE* file, void* dst, const size_t bytes)
+{
+    if (std::fread(dst, 1, bytes, file) != bytes)
+        throw "truncated frame."s;
+}
+
+static void write_exact(std::FILE* file, const void* src, const size_t bytes)
+{
+    if (std::fwrite(src, 1, bytes, file) != bytes)
+        throw "failed to write the output."s;
+}
+
+// Reads up to the next newline, false at the end of the stream before any character.
+static bool read_line(std::FILE* file, std::string& line)
+{
+    line.clear();
+
+    for (int c{ std::fgetc(file) }; c != '\n'; c = std::fgetc(file))
+    {
+        if (c == EOF)
+        {
+            if (line.empty())
+                return false;
+
+            throw "truncated header."s;
+        }
+
+        line.push_back(static_cast<char>(c));
+    }
+
+    return true;
+}
+
+// Reads a whitespace separated token of the pfm header.
+static std::string read_token(std::FILE* file)
+{
+    int c{ std::fgetc(file) };
+    while (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        c = std::fgetc(file);
+
+    std::string token;
+    for (; c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n'; c = std::fgetc(file))
+        token.push_back(static_cast<char>(c));
+
+    // the single whitespace after the last token is consumed with it
+    if (c == EOF && token.empty())
+        throw "truncated header."s;
+
+    return token;
+}
+
+static int parse_size(const std::string& s)
+{
+    char* end;
+    const long v{ std::strtol(s.c_str(), &end, 10) };
+
+    if (*end != '\0' || v <= 0 || v > (1 << 20))
+        throw "invalid frame size "s + s + "."s;
+
+    return static_cast<int>(v);
+}
+
+static void byteswap32(uint8_t* p, const size_t n) noexcept
+{
+    for (size_t i{ 0 }; i < n; ++i, p += 4)
+    {
+        std::swap(p[0], p[3]);
+        std::swap(p[1], p[2]);
+    }
+}
+
+void frame_buffer::allocate(const frame_info& info)
+{
+    const int bytes{ (info.format == frame_format::y4m) ? ((info.yuv.bits > 8) ? 2 : 1) : 4 };
+    const int chroma_width{ (info.format == frame_format::y4m) ? (info.width + info.yuv.ss_w) >> info.yuv.ss_w : info.width };
+    const int chroma_height{ (info.format == frame_format::y4m) ? (info.height + info.yuv.ss_h) >> info.yuv.ss_h : info.height };
+
+    const size_t luma{ static_cast<size_t>(info.width) * info.height * bytes };
+    const size_t chroma{ static_cast<size_t>(chroma_width) * chroma_height * bytes };
+
+    size = luma + 2 * chroma;
+    data = std::make_unique<uint8_t[]>(size);
+
+    planes[0] = data.get();
+    planes[1] = planes[0] + luma;
+    planes[2] = planes[1] + chroma;
+    pitch[0] = static_cast<ptrdiff_t>(info.width) * bytes;
+    pitch[1] = static_cast<ptrdiff_t>(chroma_width) * bytes;
+    pitch[2] = pitch[1];
+}
+
+frame_reader::frame_reader(std::FILE* file, const frame_format format, const int width, const int height, const grayworld_kernels& k)
+    : file(file), stream_info(), k(k), big_endian(false), header_read(false)
+{
+    stream_info.format = format;
+    stream_info.yuv.bits = 32;
+
+    switch (format)
+    {
+        case frame_format::rgbs:
+        case frame_format::rgbh:
+            if (width <= 0 || height <= 0)
+                throw "width and height are required for raw input."s;
+
+            stream_info.width = width;
+            stream_info.height = height;
+            break;
+        case frame_format::y4m:
+        {
+            if (!read_line(file, header) || header.compare(0, 10, "YUV4MPEG2 ") != 0)
+                throw "not a YUV4MPEG2 stream."s;
+
+            std::istringstream tokens{ header.substr(10) };
+            std::string colorspace{ "420jpeg" };
+
+            for (std::string t; tokens >> t;)
+            {
+                if (t[0] == 'W')
+                    stream_info.width = parse_size(t.substr(1));
+                else if (t[0] == 'H')
+                    stream_info.height = parse_size(t.substr(1));
+                else if (t[0] == 'C')
+                    colorspace = t.substr(1);
+                else if (t[0] == 'I' && t != "Ip" && t != "I?")
+                    throw "interlaced y4m is not supported."s;
+                else if (t == "XCOLORRANGE=FULL")
+                    stream_info.yuv.full_range = true;
+            }
+
+            if (stream_info.width <= 0 || stream_info.height <= 0)
+                throw "the y4m header has no frame size."s;
+
+            // 420, 420jpeg, 420paldv, 420mpeg2, 422, 444 with an optional p10..p16 suffix
+            const std::string sampling{ colorspace.substr(0, 3) };
+            const size_t p{ colorspace.find('p', 3) };
+            const std::string suffix{ colorspace.substr(3) };
+
+            if (sampling == "420")
+            {
+                stream_info.yuv.ss_w = 1;
+                stream_info.yuv.ss_h = 1;
+
+                // 420 and 420jpeg are centred, the high bit depth tags have no siting (ffmpeg), they are taken as MPEG-2 video
+                if (suffix.empty() || suffix == "jpeg")
+                    stream_info.yuv.chroma_location = 1;
+                else if (suffix == "paldv")
+                    stream_info.yuv.chroma_location = 2;
+            }
+            else if (sampling == "422")
+                stream_info.yuv.ss_w = 1;
+            else if (sampling != "444" || suffix == "alpha")
+                throw "y4m colorspace "s + colorspace + " is not supported."s;
+
+            stream_info.yuv.bits = 8;
+            if (p != std::string::npos && p + 1 < colorspace.size() && std::isdigit(static_cast<unsigned char>(colorspace[p + 1])))
+            {
+                stream_info.yuv.bits = std::atoi(colorspace.c_str() + p + 1);
+
+                if (stream_info.yuv.bits < 8 || stream_info.yuv.bits > 16)
+                    throw "y4m colorspace "s + colorspace + " is not supported."s;
+            }
+            break;
+        }
+        case frame_format::pfm:
+            if (!read_pfm_header())
+                throw "empty pfm input."s;
+
+            header_read = true;
+            break;
+    }
+
+    if (format == frame_format::rgbh || format == frame_format::pfm)
+        row = std::make_unique<uint8_t[]>(static_cast<size_t>(stream_info.width) * 3 * sizeof(float));
+}
+
+bool frame_reader::read_pfm_header()
+{
+    const int c{ std::fgetc(file) };
+    if (c == EOF)
+        return false;
+
+    if (c != 'P' || std::fgetc(file) != 'F')
+        throw "only RGB pfm (PF) is supported."s;
+
+    const int width{ parse_size(read_token(file)) };
+    const int height{ parse_size(read_token(file)) };
+    const std::string scale{ read_token(file) };
+
+    if (stream_info.width && (width != stream_info.width || height != stream_info.height))
+        throw "all pfm images must have the same size."s;
+
+    stream_info.width = width;
+    stream_info.height = height;
+    big_endian = std::strtod(scale.c_str(), nullptr) > 0.0;
+
+    return true;
+}
+
+bool frame_reader::read(frame_buffer& frame)
+{
+    const int width{ stream_info.width };
+    const int height{ stream_info.height };
+
+    switch (stream_info.format)
+    {
+        case frame_format::rgbs:
+        {
+            const size_t plane{ static_cast<size_t>(width) * height * sizeof(float) };
+            const size_t n{ std::fread(frame.planes[0], 1, plane, file) };
+
+            if (n == 0 && std::feof(file))
+                return false;
+            if (n != plane)
+                throw "truncated frame."s;
+
+            read_exact(file, frame.planes[1], plane);
+            read_exact(file, frame.planes[2], plane);
+            return true;
+        }
+        case frame_format::rgbh:
+        {
+            uint16_t* half{ reinterpret_cast<uint16_t*>(row.get()) };
+
+            for (int i{ 0 }; i < 3; ++i)
+            {
+                for (int y{ 0 }; y < height; ++y)
+                {
+                    const size_t n{ std::fread(half, sizeof(uint16_t), width, file) };
+
+                    if (n == 0 && i == 0 && y == 0 && std::feof(file))
+                        return false;
+                    if (n != static_cast<size_t>(width))
+                        throw "truncated frame."s;
+
+                    k.half_to_float_row(half, reinterpret_cast<float*>(frame.planes[i] + y * frame.pitch[i]), width);
+                }
+            }
+            return true;
+        }
+        case frame_format::y4m:
+        {
+            std::string line;
+            if (!read_line(file, line))
+                return false;
+            if (line.compare(0, 5, "FRAME") != 0)
+                throw "invalid y4m frame header."s;
+
+            read_exact(file, frame.planes[0], frame.size);
+            return true;
+        }
+        case frame_format::pfm:
+        {
+            if (!header_read && !read_pfm_header())
+                return false;
+
+            header_read = false;
+            float* rgb{ reinterpret_cast<float*>(row.get()) };
+
+            // the rows are stored bottom-up
+            for (int y{ height - 1 }; y >= 0; --y)
+            {
+                read_exact(file, rgb, static_cast<size_t>(width) * 3 * sizeof(float));
+
+                if (big_endian)
+                    byteswap32(row.get(), static_cast<size_t>(width) * 3);
+
+                float* r{ reinterpret_cast<float*>(frame.planes[0] + y * frame.pitch[0]) };
+                float* g{ reinterpret_cast<float*>(frame.planes[1] + y * frame.pitch[1]) };
+                float* b{ reinterpret_cast<float*>(frame.planes[2] + y * frame.pitch[2]) };
+
+                for (int x{ 0 }; x < width; ++x)
+                {
+                    r[x] = rgb[3 * x];
+                    g[x] = rgb[3 * x + 1];
+                    b[x] = rgb[3 * x + 2];
+                }
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+frame_writer::frame_writer(std::FILE* file, const frame_info& info, const std::string& y4m_header, const grayworld_kernels& k)
+    : file(file), stream_info(info), header(y4m_header), k(k), header_written(false)
+{
+    if (info.format == frame_format::rgbh || info.format == frame_format::pfm)
+        row = std::make_unique<uint8_t[]>(static_cast<size_t>(info.width) * 3 * sizeof(float));
+}
+
+void frame_writer::write(const frame_buffer& frame)
+{
+    const int width{ stream_info.width };
+    const int height{ stream_info.height };
+
+    switch (stream_info.format)
+    {
+        case frame_format::rgbs:
+            write_exact(file, frame.planes[0], frame.size);
+            break;
+        case frame_format::rgbh:
+        {
+            uint16_t* half{ reinterpret_cast<uint16_t*>(row.get()) };
+
+            for (int i{ 0 }; i < 3; ++i)
+            {
+                for (int y{ 0 }; y < height; ++y)
+                {
+                    k.float_to_half_row(reinterpret_cast<const float*>(frame.planes[i] + y * frame.pitch[i]), half, width);
+                    write_exact(file, half, static_cast<size_t>(width) * sizeof(uint16_t));
+                }
+            }
+            break;
+        }
+        case frame_format::y4m:
+            if (!header_written)
+            {
+                write_exact(file, header.data(), header.size());
+                write_exact(file, "\n", 1);
+                header_written = true;
+            }
+
+            write_exact(file, "FRAME\n", 6);
+            write_exact(file, frame.planes[0], frame.size);
+            break;
+        case frame_format::pfm:
+        {
+            const std::string pfm_header{ "PF\n"s + std::to_string(width) + " "s + std::to_string(height) + "\n-1.0\n"s };
+            write_exact(file, pfm_header.data(), pfm_header.size());
+
+            float* rgb{ reinterpret_cast<float*>(row.get()) };
+
+            for (int y{ height - 1 }; y >= 0; --y)
+            {
+                const float* r{ reinterpret_cast<const float*>(frame.planes[0] + y * frame.pitch[0]) };
+                const float* g{ reinterpret_cast<const float*>(frame.planes[1] + y * frame.pitch[1]) };
+                const float* b{ reinterpret_cast<const float*>(frame.planes[2] + y * frame.pitch[2]) };
+
+                for (int x{ 0 }; x < width; ++x)
+                {
+                    rgb[3 * x] = r[x];
+                    rgb[3 * x + 1] = g[x];
+                    rgb[3 * x + 2] = b[x];
+                }
+
+                write_exact(file, rgb, static_cast<size_t>(width) * 3 * sizeof(float));
+            }
+            break;
+        }
+    }
+}
+
+size_t parse_pfm_header(const uint8_t* data, const size_t size, int& width, int& height, bool& big_endian)
+{
+    size_t pos{ 2 };
+    // the same tokens as read_token()
+    const auto token{ [&]
+        {
+            while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n'))
+                ++pos;
+
+            const size_t start{ pos };
+            while (pos < size && data[pos] != ' ' && data[pos] != '\t' && data[pos] != '\r' && data[pos] != '\n')
+                ++pos;
+
+            if (pos == size)
+                throw "truncated header."s;
+
+            return std::string(reinterpret_cast<const char*>(data) + start, pos++ - start);
+        } };
+
+    if (size < 2 || data[0] != 'P' || data[1] != 'F')
+        throw "only RGB pfm (PF) is supported."s;
+
+    width = parse_size(token());
+    height = parse_size(token());
+    big_endian = std::strtod(token().c_str(), nullptr) > 0.0;
+
+    return pos;
+}
+
+frame_format parse_frame_format(const std::string& name, const std::string& path)
+{
+    std::string f{ name };
+
+    if (f.empty())
+    {
+        const size_t dot{ path.rfind('.') };
+        if (dot == std::string::npos || path == "-")
+            throw "the format of "s + path + " can't be derived from its name, use --format."s;
+
+        f = path.substr(dot + 1);
+        std::transform(f.begin(), f.end(), f.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    }
+
+    if (f == "rgbs" || f == "raw")
+        return frame_format::rgbs;
+    if (f == "rgbh")
+        return frame_format::rgbh;
+    if (f == "y4m")
+        return frame_format::y4m;
+    if (f == "pfm")
+        return frame_format::pfm;
+
+    throw "unknown format "s + f + "."s;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "../common/grayworld_core.h"
+
+// rgbs/rgbh: raw planar float/half float R, G, B planes per frame.
+// y4m: YUV4MPEG2 4:2:0, 4:2:2, 4:4:4 8..16-bit.
+// pfm: a sequence of Portable Float Maps (RGB, rows bottom-up).
+enum class frame_format
+{
+    rgbs,
+    rgbh,
+    y4m,
+    pfm
+};
+
+struct frame_info
+{
+    frame_format format;
+    int width;
+    int height;
+    // ss_w, ss_h and bits of the y4m stream
+    grayworld_yuv yuv;
+};
+
+// One frame in the layout of the core: float R, G, B planes or Y, U, V planes of the y4m stream.
+struct frame_buffer
+{
+    std::unique_ptr<uint8_t[]> data;
+    uint8_t* planes[3];
+    ptrdiff_t pitch[3];
+    size_t size;
+
+    void allocate(const frame_info& info);
+};
+
+// Reads the frames of a stream. The errors are thrown as std::string.
+class frame_reader
+{
+public:
+    // width and height are only used by the raw formats, the others read them from the first header.
+    frame_reader(std::FILE* file, const frame_format format, const int width, const int height, const grayworld_kernels& k);
+
+    const frame_info& info() const noexcept
+    {
+        return stream_info;
+    }
+
+    // The YUV4MPEG2 stream header (without the newline), empty for the other formats.
+    const std::string& y4m_header() const noexcept
+    {
+        return header;
+    }
+
+    // False at the end of the stream.
+    bool read(frame_buffer& frame);
+
+private:
+    bool read_pfm_header();
+
+    std::FILE* file;
+    frame_info stream_info;
+    std::string header;
+    const grayworld_kernels& k;
+    // the pfm scale > 0 (big endian)
+    bool big_endian;
+    bool header_read;
+    std::unique_ptr<uint8_t[]> row;
+};
+
+// Writes the frames in the format of the input.
+class frame_writer
+{
+public:
+    frame_writer(std::FILE* file, const frame_info& info, const std::string& y4m_header, const grayworld_kernels& k);
+
+    void write(const frame_buffer& frame);
+
+private:
+    std::FILE* file;
+    frame_info stream_info;
+    std::string header;
+    const grayworld_kernels& k;
+    bool header_written;
+    std::unique_ptr<uint8_t[]> row;
+};
+
+// Parses the header of a pfm image of size bytes in memory. Returns the offset of the pixels.
+size_t parse_pfm_header(const uint8_t* data, const size_t size, int& width, int& height, bool& big_endian);
+
+// Parses rgbs, rgbh, y4m or pfm. Empty name: derived from the extension of path.
+frame_format parse_frame_format(const std::string& name, const std::string& path);
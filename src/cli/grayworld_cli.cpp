@@ -0,0 +1,342 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "cli.h"
+#include "frame_io.h"
+#include "work_queue.h"
+#include "../common/scratch.h"
+#include "../common/stats.h"
+#include "../common/thread_pool.h"
+
+using namespace std::literals;
+
+static constexpr char usage[]{
+    "Usage: grayworld-cli [options] input output\n"
+    "       grayworld-cli --batch [options] list output_directory\n"
+    "  input/output: file name or - for stdin/stdout. The output has the format of the input.\n"
+    "  --batch                     list: the images (rgbs, rgbh, pfm) one per line or - for stdin\n"
+    "  --format rgbs|rgbh|y4m|pfm  input format (default: the extension of input)\n"
+    "  --width n --height n        frame size of raw rgbs/rgbh input\n"
+    "  --cc 0|1                    0: mean, 1: median (default: 0)\n"
+    "  --opt -1..4                 cpu optimizations (default: -1)\n"
+    "  --matrix 1|9                y4m matrix (default: 1)\n"
+    "  --transfer 1|6|14|15|16     y4m transfer (default: 1)\n"
+    "  --tile n                    strip height, -1: auto, 0: full frame (default: 0)\n"
+    "  --threads n                 row bands per frame (--batch: images in parallel), 0: the size of the pool (default: 0)\n"
+    "  --debug                     print the performance counters\n"
+};
+
+static cli_options parse_options(const int argc, char** argv)
+{
+    cli_options o;
+    int positional{ 0 };
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg{ argv[i] };
+
+        if (arg == "--debug")
+        {
+            o.debug = true;
+            continue;
+        }
+        if (arg == "--batch")
+        {
+            o.batch = true;
+            continue;
+        }
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+        {
+            if (i + 1 >= argc)
+                throw arg + " requires a value."s;
+
+            const std::string value{ argv[++i] };
+
+            if (arg == "--format")
+            {
+                o.format = value;
+                continue;
+            }
+
+            char* end;
+            const long v{ std::strtol(value.c_str(), &end, 10) };
+            if (*end != '\0' || value.empty())
+                throw arg + " requires an integer."s;
+
+            const int n{ static_cast<int>(std::clamp<long>(v, -(1 << 30), 1 << 30)) };
+
+            if (arg == "--width")
+                o.width = n;
+            else if (arg == "--height")
+                o.height = n;
+            else if (arg == "--cc")
+                o.cc = n;
+            else if (arg == "--opt")
+                o.opt = n;
+            else if (arg == "--matrix")
+                o.matrix = n;
+            else if (arg == "--transfer")
+                o.transfer = n;
+            else if (arg == "--tile")
+                o.tile = n;
+            else if (arg == "--threads")
+                o.threads = n;
+            else
+                throw "unknown option "s + arg + "."s;
+
+            continue;
+        }
+
+        if (positional == 0)
+            o.input = arg;
+        else if (positional == 1)
+            o.output = arg;
+        else
+            throw "too many arguments."s;
+
+        ++positional;
+    }
+
+    if (positional != 2)
+        throw "input and output are required."s;
+    if (o.cc < 0 || o.cc > 1)
+        throw "cc must be either 0 or 1."s;
+    if (o.opt < -1 || o.opt > 4)
+        throw "opt must be between -1..4."s;
+    if (o.matrix != 1 && o.matrix != 9)
+        throw "matrix must be either 1 or 9."s;
+    if (o.transfer != 1 && o.transfer != 6 && o.transfer != 14 && o.transfer != 15 && o.transfer != 16)
+        throw "transfer must be 1, 6, 14, 15 or 16."s;
+    if (o.tile < -1)
+        throw "tile must be greater than or equal to -1."s;
+    if (o.threads < 0)
+        throw "threads must be greater than or equal to 0."s;
+
+    return o;
+}
+
+static std::FILE* open_file(const std::string& path, const bool write)
+{
+    if (path == "-")
+    {
+        std::FILE* f{ (write) ? stdout : stdin };
+#if defined(_WIN32)
+        _setmode(_fileno(f), _O_BINARY);
+#endif
+        return f;
+    }
+
+    std::FILE* f{ std::fopen(path.c_str(), (write) ? "wb" : "rb") };
+    if (!f)
+        throw "failed to open "s + path + "."s;
+
+    return f;
+}
+
+static int run(const cli_options& o)
+{
+    const frame_format format{ parse_frame_format(o.format, o.input) };
+    const grayworld_mode mode{ (o.cc == 0) ? grayworld_mode::mean : grayworld_mode::median };
+    const grayworld_input input{ (format == frame_format::y4m) ? grayworld_input::yuv : grayworld_input::planar };
+
+    if (o.opt >= 0 && !grayworld_supports(grayworld_cpu_features(), o.opt, false))
+        throw "opt="s + std::to_string(o.opt) + " is not supported by the CPU."s;
+
+    grayworld_kernels kernels{ get_kernels(grayworld_dispatch(o.opt, grayworld_cpu_features(), false), mode, input, grayworld_layout::planar, grayworld_precision::fp32, false, -1) };
+    kernels.bands = (o.threads == 0) ? thread_pool::shared().size() : std::min(o.threads, thread_pool::shared().size());
+
+    std::FILE* in{ open_file(o.input, false) };
+    std::FILE* out{ open_file(o.output, true) };
+    // large stdio buffers, the pipes are read and written in big blocks
+    std::setvbuf(in, nullptr, _IOFBF, 1 << 20);
+    std::setvbuf(out, nullptr, _IOFBF, 1 << 20);
+
+    frame_reader reader{ in, format, o.width, o.height, kernels };
+    frame_info info{ reader.info() };
+
+    if (input == grayworld_input::yuv)
+    {
+        info.yuv.kr = (o.matrix == 1) ? 0.2126f : 0.2627f;
+        info.yuv.kb = (o.matrix == 1) ? 0.0722f : 0.0593f;
+        info.yuv.transfer = (o.transfer == 16) ? grayworld_transfer::pq : grayworld_transfer::bt709;
+    }
+
+    frame_writer writer{ out, info, reader.y4m_header(), kernels };
+
+    const int width{ info.width };
+    const int height{ info.height };
+    const int strip_height{ (o.tile != 0) ? std::min(tile_height(width, o.tile), height + (height & 1)) : 0 };
+    // the strips read the chroma rows above them with vertical subsampling, that are already corrected in place
+    const bool in_place{ !strip_height || !info.yuv.ss_h };
+
+    const size_t lab_size{ lab_scratch_size(kernels, width, (strip_height) ? strip_height * kernels.bands : height) };
+    const size_t row_bytes{ sizeof(float) * kernels.bands * row_scratch_size(kernels, input, width) };
+    scratch_pool pool{ lab_size, height, row_bytes, false };
+
+    grayworld_stats stats;
+    stats.enabled = o.debug || grayworld_debug_env();
+    stats.isa = kernels.isa;
+    stats.bands = kernels.bands;
+
+    // double buffering: two frames between every pair of stages
+    constexpr int slot_count{ 4 };
+    frame_buffer slots[slot_count];
+    frame_buffer corrected;
+    work_queue<frame_buffer*> free_slots;
+    work_queue<frame_buffer*> read_slots;
+    work_queue<frame_buffer*> done_slots;
+
+    for (frame_buffer& slot : slots)
+    {
+        slot.allocate(info);
+        free_slots.push(&slot);
+    }
+
+    if (!in_place)
+        corrected.allocate(info);
+
+    std::string read_error;
+    std::string write_error;
+    int64_t frames{ 0 };
+
+    std::thread read_thread{ [&]
+        {
+            try
+            {
+                for (frame_buffer* slot; free_slots.pop(slot);)
+                {
+                    if (!reader.read(*slot))
+                        break;
+
+                    read_slots.push(slot);
+                }
+            }
+            catch (const std::string& error)
+            {
+                read_error = error;
+            }
+
+            read_slots.close();
+        } };
+
+    std::thread write_thread{ [&]
+        {
+            try
+            {
+                for (frame_buffer* slot; done_slots.pop(slot);)
+                {
+                    writer.write(*slot);
+                    free_slots.push(slot);
+                }
+
+                if (std::fflush(out) != 0)
+                    throw "failed to write the output."s;
+            }
+            catch (const std::string& error)
+            {
+                write_error = error;
+                // stops the reader, the remaining frames are dropped
+                free_slots.close();
+                for (frame_buffer* slot; done_slots.pop(slot);)
+                    ;
+            }
+        } };
+
+    for (frame_buffer* slot; read_slots.pop(slot);)
+    {
+        const scratch_pool::lease scratch{ pool.acquire() };
+        if (!scratch)
+        {
+            free_slots.close();
+            read_error = "failed to allocate the scratch memory.";
+            break;
+        }
+
+        stats.add_scratch(pool.bytes());
+
+        float* lab{ scratch->lab.get() };
+        float* line_sum{ scratch->line_sum.get() };
+        int* line_count_pels{ scratch->line_count_pels.get() };
+        float* rows{ scratch->rows.get() };
+        const uint8_t* const* srcp{ slot->planes };
+        uint8_t* const* dstp{ (in_place) ? slot->planes : corrected.planes };
+
+        grayworld_stats::frame_scope frame{ stats };
+
+        const auto t0{ std::chrono::steady_clock::now() };
+        if (strip_height)
+            convert_frame_tiled(kernels, mode, input, info.yuv, lab, strip_height, rows, srcp, slot->pitch, line_sum, line_count_pels, width, height);
+        else
+            convert_frame(kernels, mode, input, info.yuv, lab, rows, srcp, slot->pitch, line_sum, line_count_pels, width, height);
+        const auto t1{ std::chrono::steady_clock::now() };
+        const std::pair<float, float> avg{ kernels.compute(line_sum, line_count_pels, height) };
+        const auto t2{ std::chrono::steady_clock::now() };
+        if (strip_height)
+            correct_frame_tiled(kernels, input, info.yuv, lab, strip_height, rows, srcp, slot->pitch, dstp, slot->pitch, avg, line_sum, line_count_pels, width, height);
+        else
+            correct_frame(kernels, input, info.yuv, dstp, slot->pitch, lab, rows, avg, width, height);
+        const auto t3{ std::chrono::steady_clock::now() };
+
+        if (!in_place)
+            std::swap(slot->data, corrected.data), std::swap(slot->planes, corrected.planes);
+
+        frame.end(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(), std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count(),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count());
+
+        done_slots.push(slot);
+        ++frames;
+    }
+
+    done_slots.close();
+    // unblocks the reader after an error of the processing stage
+    free_slots.close();
+    read_thread.join();
+    write_thread.join();
+
+    if (in != stdin)
+        std::fclose(in);
+    if (out != stdout)
+        std::fclose(out);
+
+    if (stats.enabled)
+        stats.dump();
+
+    if (!read_error.empty())
+        throw read_error;
+    if (!write_error.empty())
+        throw write_error;
+
+    if (frames == 0)
+        std::fprintf(stderr, "grayworld-cli: no frames.\n");
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || !std::strcmp(argv[1], "--help") || !std::strcmp(argv[1], "-h"))
+    {
+        std::fputs(usage, stderr);
+        return (argc < 2) ? 1 : 0;
+    }
+
+    try
+    {
+        const cli_options o{ parse_options(argc, argv) };
+
+        return (o.batch) ? run_batch(o) : run(o);
+    }
+    catch (const std::string& error)
+    {
+        std::fprintf(stderr, "grayworld-cli: %s\n", error.c_str());
+        return 1;
+    }
+}
@@ -0,0 +1,175 @@
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+using namespace std::literals;
+
+#if defined(_WIN32)
+// Closes file.
+static uint8_t* map_file(HANDLE file, const std::string& path, const size_t size, const bool write)
+{
+    HANDLE mapping{ CreateFileMappingA(file, nullptr, (write) ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+        static_cast<DWORD>(size), nullptr) };
+    CloseHandle(file);
+
+    if (!mapping)
+        throw "failed to map "s + path + "."s;
+
+    // the view keeps the mapping alive
+    void* p{ MapViewOfFile(mapping, (write) ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size) };
+    CloseHandle(mapping);
+
+    if (!p)
+        throw "failed to map "s + path + "."s;
+
+    return static_cast<uint8_t*>(p);
+}
+
+mapped_file mapped_file::open(const std::string& path)
+{
+    HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        throw "failed to open "s + path + "."s;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        throw path + " is empty."s;
+    }
+
+    mapped_file m;
+    m.ptr = map_file(file, path, static_cast<size_t>(size.QuadPart), false);
+    m.bytes = static_cast<size_t>(size.QuadPart);
+
+#if _WIN32_WINNT >= 0x0602
+    WIN32_MEMORY_RANGE_ENTRY range{ m.ptr, m.bytes };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+
+    return m;
+}
+
+mapped_file mapped_file::create(const std::string& path, const size_t size)
+{
+    HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr) };
+    if (file == INVALID_HANDLE_VALUE)
+        throw "failed to create "s + path + "."s;
+
+    mapped_file m;
+
+    try
+    {
+        m.ptr = map_file(file, path, size, true);
+    }
+    catch (const std::string&)
+    {
+        DeleteFileA(path.c_str());
+        throw;
+    }
+
+    m.bytes = size;
+
+    return m;
+}
+
+mapped_file::~mapped_file()
+{
+    if (ptr)
+        UnmapViewOfFile(ptr);
+}
+#else
+mapped_file mapped_file::open(const std::string& path)
+{
+    const int fd{ ::open(path.c_str(), O_RDONLY) };
+    if (fd < 0)
+        throw "failed to open "s + path + "."s;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0)
+    {
+        close(fd);
+        throw path + " is empty."s;
+    }
+
+    // the whole image is read once from the start, the kernel reads it ahead while the image before it is processed
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    void* p{ mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0) };
+    close(fd);
+
+    if (p == MAP_FAILED)
+        throw "failed to map "s + path + "."s;
+
+    madvise(p, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+
+    mapped_file m;
+    m.ptr = static_cast<uint8_t*>(p);
+    m.bytes = static_cast<size_t>(st.st_size);
+
+    return m;
+}
+
+mapped_file mapped_file::create(const std::string& path, const size_t size)
+{
+    const int fd{ ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) };
+    if (fd < 0)
+        throw "failed to create "s + path + "."s;
+
+    if (ftruncate(fd, static_cast<off_t>(size)))
+    {
+        close(fd);
+        unlink(path.c_str());
+        throw "failed to create "s + path + "."s;
+    }
+
+    void* p{ mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) };
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        unlink(path.c_str());
+        throw "failed to map "s + path + "."s;
+    }
+
+    mapped_file m;
+    m.ptr = static_cast<uint8_t*>(p);
+    m.bytes = size;
+
+    return m;
+}
+
+mapped_file::~mapped_file()
+{
+    if (ptr)
+        munmap(ptr, bytes);
+}
+#endif
+
+mapped_file::mapped_file(mapped_file&& other) noexcept : ptr(std::exchange(other.ptr, nullptr)), bytes(std::exchange(other.bytes, 0))
+{
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        mapped_file old{ std::move(*this) };
+        ptr = std::exchange(other.ptr, nullptr);
+        bytes = std::exchange(other.bytes, 0);
+    }
+
+    return *this;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory. The errors are thrown as std::string.
+class mapped_file
+{
+public:
+    mapped_file() noexcept : ptr(nullptr), bytes(0)
+    {
+    }
+
+    // Maps path read-only and starts reading the whole file ahead in the background.
+    static mapped_file open(const std::string& path);
+    // Creates (or truncates) path with size bytes and maps it writable. The file is removed when it can't be mapped.
+    static mapped_file create(const std::string& path, const size_t size);
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+
+    uint8_t* data() const noexcept
+    {
+        return ptr;
+    }
+
+    size_t size() const noexcept
+    {
+        return bytes;
+    }
+
+private:
+    uint8_t* ptr;
+    size_t bytes;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// A hand-off between two pipeline stages. With a capacity push() blocks while the queue is full.
+template <typename T>
+class work_queue
+{
+public:
+    // capacity 0: unbounded
+    explicit work_queue(const size_t capacity = 0) noexcept : capacity(capacity)
+    {
+    }
+
+    // False when the queue is closed, the item is dropped.
+    bool push(T item)
+    {
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            not_full.wait(lock, [this] { return !capacity || items.size() < capacity || closed; });
+
+            if (closed)
+                return false;
+
+            items.push_back(std::move(item));
+        }
+        not_empty.notify_one();
+        return true;
+    }
+
+    // False when the queue is closed and empty.
+    bool pop(T& item)
+    {
+        {
+            std::unique_lock<std::mutex> lock{ mutex };
+            not_empty.wait(lock, [this] { return !items.empty() || closed; });
+
+            if (items.empty())
+                return false;
+
+            item = std::move(items.front());
+            items.pop_front();
+        }
+        not_full.notify_one();
+        return true;
+    }
+
+    // The queued items are still popped, the blocked push() calls return false.
+    void close()
+    {
+        {
+            const std::lock_guard<std::mutex> lock{ mutex };
+            closed = true;
+        }
+        not_empty.notify_all();
+        not_full.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed{ false };
+};
@@ -1,8 +1,15 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 #include <vector>
 
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define GRAYWORLD_ARM64
+#endif
+
 static constexpr float lms2lab[3][3]{
     {0.5774f, 0.5774f, 0.5774f},
     {0.40825f, 0.40825f, -0.816458f},
@@ -27,14 +34,157 @@ static constexpr float lms2rgb[3][3]{
     {0.0497f, -0.2439f, 1.2045f}
 };
 
+// PQ (SMPTE ST 2084) constants
+static constexpr float pq_m1{ 2610.0f / 16384.0f };
+static constexpr float pq_m2{ 2523.0f / 4096.0f * 128.0f };
+static constexpr float pq_c1{ 3424.0f / 4096.0f };
+static constexpr float pq_c2{ 2413.0f / 4096.0f * 32.0f };
+static constexpr float pq_c3{ 2392.0f / 4096.0f * 32.0f };
+
 enum class grayworld_mode
 {
     mean,
     median
 };
 
+enum class grayworld_transfer
+{
+    bt709,
+    pq
+};
+
+// YUV matrix coefficients and transfer function of a YUV clip.
+struct grayworld_yuv
+{
+    float kr;
+    float kb;
+    grayworld_transfer transfer;
+    int ss_w;
+    int ss_h;
+    int bits;
+    // siting of the subsampled chroma, the values of _ChromaLocation: 0 - left, 1 - center, 2 - top left, 3 - top
+    int chroma_location;
+    // integer samples are full range instead of limited range
+    bool full_range;
+};
+
 void rgb2lab_c(const float rgb[3], float lab[3]) noexcept;
 void lab2rgb_c(const float lab[3], float rgb[3]) noexcept;
 
 template <grayworld_mode mode>
 std::pair<float, float> compute_correction(float* line_sum, int* line_count_pels, const int height) noexcept;
+
+// The LAB values of a row are stored in blocks of lab_block pixels, lab_step floats apart.
+// lab_step == lab_block is a contiguous row, lab_step == 3 * lab_block is the interleaved [L | a | b] layout.
+static constexpr int lab_block{ 16 };
+
+static inline int lab_offset(const int x, const int lab_step) noexcept
+{
+    return x / lab_block * lab_step + x % lab_block;
+}
+
+// Returns the number of pixels before p0, p1 and p2 are aligned to bytes, or -1 when they can't be aligned together.
+template <int bytes>
+static inline int stream_head(const float* p0, const float* p1, const float* p2, const int width) noexcept
+{
+    const uintptr_t misalign{ reinterpret_cast<uintptr_t>(p0) & (bytes - 1) };
+
+    if ((misalign & 3) || (reinterpret_cast<uintptr_t>(p1) & (bytes - 1)) != misalign || (reinterpret_cast<uintptr_t>(p2) & (bytes - 1)) != misalign)
+        return -1;
+
+    return std::min(static_cast<int>(((bytes - misalign) & (bytes - 1)) / 4), width);
+}
+
+// Row kernels. convert_row_* converts one row of linear RGB to LAB and adds the a/b values of the row to a_sum/b_sum.
+// correct_row_* subtracts avg from the a/b values of one LAB row and converts it back to linear RGB clamped to 0..1.
+// The SIMD versions prefetch the LAB values prefetch pixels ahead (0 - disabled), the C version ignores it.
+void convert_row_c(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_c(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_sse2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_sse2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_avx2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_avx2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_avx512(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_avx512(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+// AVX512-FP16 versions. They evaluate the log/exp polynomials in half precision.
+void convert_row_avx512fp16(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_avx512fp16(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+// NEON versions (AArch64). There are no separate streaming versions, the regular ones are used for stream=true.
+void convert_row_neon(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_neon(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+// Versions with non-temporal stores of the LAB values (planar scratch only) and of the output rows.
+// They fall back to the regular versions when the three destination rows can't be aligned together.
+void convert_row_stream_sse2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_stream_sse2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_stream_avx2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_stream_avx2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_stream_avx512(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_stream_avx512(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+void convert_row_stream_avx512fp16(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+void correct_row_stream_avx512fp16(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+
+// Packed RGB row loaders. The source is in BGR(A) order, 8-bit (rgb24/rgb32) or 16-bit (rgb48/rgb64) per component.
+// The output is planar float normalized to 0..1. The alpha channel is ignored.
+void unpack_rgb24_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb32_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb48_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb64_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+
+void unpack_rgb24_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb32_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb48_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb64_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+
+void unpack_rgb24_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb32_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb48_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb64_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+
+void unpack_rgb24_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb32_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb48_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb64_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+
+void unpack_rgb24_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb32_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb48_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+void unpack_rgb64_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+
+// YUV row converters. yuv_to_rgb_row_* converts full resolution Y'CbCr (Y 0..1, Cb/Cr -0.5..0.5) to linear RGB.
+// rgb_to_yuv_row_* converts linear RGB back to Y'CbCr.
+void yuv_to_rgb_row_c(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+void rgb_to_yuv_row_c(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+
+void yuv_to_rgb_row_sse2(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+void rgb_to_yuv_row_sse2(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+
+void yuv_to_rgb_row_avx2(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+void rgb_to_yuv_row_avx2(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+
+void yuv_to_rgb_row_avx512(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+void rgb_to_yuv_row_avx512(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+
+void yuv_to_rgb_row_neon(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+void rgb_to_yuv_row_neon(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+
+// FP16 converters of the reduced precision LAB scratch. Rounding is to nearest even, the _avx2 versions require F16C.
+void float_to_half_row_c(const float* src, uint16_t* __restrict dst, const int width) noexcept;
+void half_to_float_row_c(const uint16_t* src, float* __restrict dst, const int width) noexcept;
+
+void float_to_half_row_avx2(const float* src, uint16_t* __restrict dst, const int width) noexcept;
+void half_to_float_row_avx2(const uint16_t* src, float* __restrict dst, const int width) noexcept;
+
+void float_to_half_row_avx512(const float* src, uint16_t* __restrict dst, const int width) noexcept;
+void half_to_float_row_avx512(const uint16_t* src, float* __restrict dst, const int width) noexcept;
+
+void float_to_half_row_neon(const float* src, uint16_t* __restrict dst, const int width) noexcept;
+void half_to_float_row_neon(const uint16_t* src, float* __restrict dst, const int width) noexcept;
@@ -39,3 +39,336 @@ void lab2rgb_avx2(const Vec8f l_lab, const Vec8f a_lab, const Vec8f b_lab, Vec8f
 
     apply_matrix_avx2(lms2rgb, l_lms, m_lms, s_lms, r, g, b);
 }
+
+void convert_row_avx2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    Vec8f l1;
+    Vec8f a1;
+    Vec8f b1;
+    Vec8f a_acc{ zero_8f() };
+    Vec8f b_acc{ zero_8f() };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        rgb2lab_avx2(Vec8f().load(r + x), Vec8f().load(g + x), Vec8f().load(b + x), l1, a1, b1);
+
+        const int i{ lab_offset(x, lab_step) };
+        l1.store(l_lab + i);
+        a1.store(a_lab + i);
+        b1.store(b_lab + i);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod8 < width)
+    {
+        // the tail is shorter than a vector and never crosses a block
+        const int i{ lab_offset(width_mod8, lab_step) };
+        convert_row_c(r + width_mod8, g + width_mod8, b + width_mod8, l_lab + i, a_lab + i, b_lab + i, width - width_mod8, lab_step, a_sum, b_sum);
+    }
+}
+
+void correct_row_avx2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const Vec8f avg_a{ avg.first };
+    const Vec8f avg_b{ avg.second };
+
+    Vec8f r1;
+    Vec8f g1;
+    Vec8f b1;
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        // subtract the average for the color channels and convert back to linear rgb
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 8)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_avx2(Vec8f().load(l_lab + i), Vec8f().load(a_lab + i) - avg_a, Vec8f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec8f(1.0f)), Vec8f(0.0f)).store(r + x);
+        max(min(g1, Vec8f(1.0f)), Vec8f(0.0f)).store(g + x);
+        max(min(b1, Vec8f(1.0f)), Vec8f(0.0f)).store(b + x);
+    }
+
+    if (width_mod8 < width)
+    {
+        const int i{ lab_offset(width_mod8, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod8, g + width_mod8, b + width_mod8, avg, width - width_mod8, lab_step, 0);
+    }
+}
+
+void convert_row_stream_avx2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int head{ (lab_step == lab_block) ? stream_head<32>(l_lab, a_lab, b_lab, width) : -1 };
+    if (head < 0)
+    {
+        convert_row_avx2(r, g, b, l_lab, a_lab, b_lab, width, lab_step, a_sum, b_sum);
+        return;
+    }
+
+    convert_row_c(r, g, b, l_lab, a_lab, b_lab, head, lab_step, a_sum, b_sum);
+
+    const int width_mod8{ head + ((width - head) & ~7) };
+
+    Vec8f l1;
+    Vec8f a1;
+    Vec8f b1;
+    Vec8f a_acc{ zero_8f() };
+    Vec8f b_acc{ zero_8f() };
+
+    for (int x{ head }; x < width_mod8; x += 8)
+    {
+        rgb2lab_avx2(Vec8f().load(r + x), Vec8f().load(g + x), Vec8f().load(b + x), l1, a1, b1);
+
+        l1.store_nt(l_lab + x);
+        a1.store_nt(a_lab + x);
+        b1.store_nt(b_lab + x);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod8 < width)
+        convert_row_c(r + width_mod8, g + width_mod8, b + width_mod8, l_lab + width_mod8, a_lab + width_mod8, b_lab + width_mod8, width - width_mod8, lab_step, a_sum, b_sum);
+
+    _mm_sfence();
+}
+
+void correct_row_stream_avx2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    // a head would shift the vectors across the blocks of the interleaved layout
+    const int head{ stream_head<32>(r, g, b, width) };
+    if (head < 0 || (head > 0 && lab_step != lab_block))
+    {
+        correct_row_avx2(l_lab, a_lab, b_lab, r, g, b, avg, width, lab_step, prefetch);
+        return;
+    }
+
+    correct_row_c(l_lab, a_lab, b_lab, r, g, b, avg, head, lab_step, 0);
+
+    const int width_mod8{ head + ((width - head) & ~7) };
+    const Vec8f avg_a{ avg.first };
+    const Vec8f avg_b{ avg.second };
+
+    Vec8f r1;
+    Vec8f g1;
+    Vec8f b1;
+
+    for (int x{ head }; x < width_mod8; x += 8)
+    {
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 8)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_avx2(Vec8f().load(l_lab + i), Vec8f().load(a_lab + i) - avg_a, Vec8f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec8f(1.0f)), Vec8f(0.0f)).store_nt(r + x);
+        max(min(g1, Vec8f(1.0f)), Vec8f(0.0f)).store_nt(g + x);
+        max(min(b1, Vec8f(1.0f)), Vec8f(0.0f)).store_nt(b + x);
+    }
+
+    if (width_mod8 < width)
+    {
+        const int i{ lab_offset(width_mod8, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod8, g + width_mod8, b + width_mod8, avg, width - width_mod8, lab_step, 0);
+    }
+
+    _mm_sfence();
+}
+
+void unpack_rgb24_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each load reads 32 bytes but uses 24, keep the last load inside the row
+    const int width_mod8{ std::max(width - 3, 0) & ~7 };
+    const Vec8f scale{ 1.0f / 255.0f };
+    const Vec8ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8ui px{ Vec8ui(permute32<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1, 15, 16, 17, -1, 18, 19, 20, -1, 21, 22, 23, -1>(Vec32uc().load(src + x * 3))) };
+
+        (to_float(Vec8i(px & mask)) * scale).store(b + x);
+        (to_float(Vec8i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec8i(px >> 16)) * scale).store(r + x);
+    }
+
+    unpack_rgb24_row_c(src + width_mod8 * 3, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+void unpack_rgb32_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const Vec8f scale{ 1.0f / 255.0f };
+    const Vec8ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8ui px{ Vec8ui().load(src + x * 4) };
+
+        (to_float(Vec8i(px & mask)) * scale).store(b + x);
+        (to_float(Vec8i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec8i((px >> 16) & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb32_row_c(src + width_mod8 * 4, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+void unpack_rgb48_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each half of the pixels is loaded with 32 bytes but uses 24, keep the last load inside the row
+    const int width_mod8{ std::max(width - 2, 0) & ~7 };
+    const Vec8f scale{ 1.0f / 65535.0f };
+    const Vec8ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8ui p0{ Vec8ui(permute16<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1>(Vec16us().load(src + x * 6))) };
+        const Vec8ui p1{ Vec8ui(permute16<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1>(Vec16us().load(src + x * 6 + 24))) };
+        const Vec8ui lo{ blend8<0, 2, 4, 6, 8, 10, 12, 14>(p0, p1) };
+        const Vec8ui hi{ blend8<1, 3, 5, 7, 9, 11, 13, 15>(p0, p1) };
+
+        (to_float(Vec8i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec8i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec8i(hi)) * scale).store(r + x);
+    }
+
+    unpack_rgb48_row_c(src + width_mod8 * 6, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+void unpack_rgb64_row_avx2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const Vec8f scale{ 1.0f / 65535.0f };
+    const Vec8ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8ui p0{ Vec8ui().load(src + x * 8) };
+        const Vec8ui p1{ Vec8ui().load(src + x * 8 + 32) };
+        const Vec8ui lo{ blend8<0, 2, 4, 6, 8, 10, 12, 14>(p0, p1) };
+        const Vec8ui hi{ blend8<1, 3, 5, 7, 9, 11, 13, 15>(p0, p1) };
+
+        (to_float(Vec8i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec8i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec8i(hi & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb64_row_c(src + width_mod8 * 8, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+static inline Vec8f to_linear_avx2(const Vec8f v0, const grayworld_transfer transfer) noexcept
+{
+    const Vec8f v{ max(min(v0, Vec8f(1.0f)), Vec8f(0.0f)) };
+
+    if (transfer == grayworld_transfer::bt709)
+        return select(v < Vec8f(0.081f), v * (1.0f / 4.5f), pow((v + 0.099f) * (1.0f / 1.099f), 1.0f / 0.45f));
+
+    const Vec8f p{ pow(v, 1.0f / pq_m2) };
+    return pow(max(p - pq_c1, Vec8f(0.0f)) / (Vec8f(pq_c2) - pq_c3 * p), 1.0f / pq_m1);
+}
+
+static inline Vec8f from_linear_avx2(const Vec8f l, const grayworld_transfer transfer) noexcept
+{
+    if (transfer == grayworld_transfer::bt709)
+        return select(l < Vec8f(0.018f), l * 4.5f, 1.099f * pow(l, 0.45f) - 0.099f);
+
+    const Vec8f p{ pow(l, pq_m1) };
+    return pow((pq_c1 + pq_c2 * p) / (1.0f + pq_c3 * p), pq_m2);
+}
+
+void yuv_to_rgb_row_avx2(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const Vec8f cr{ 2.0f * (1.0f - yuv.kr) };
+    const Vec8f cb{ 2.0f * (1.0f - yuv.kb) };
+    const Vec8f kr{ yuv.kr };
+    const Vec8f kb{ yuv.kb };
+    const Vec8f kg_rcp{ 1.0f / (1.0f - yuv.kr - yuv.kb) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8f y1{ Vec8f().load(y + x) };
+        const Vec8f rp{ mul_add(cr, Vec8f().load(v + x), y1) };
+        const Vec8f bp{ mul_add(cb, Vec8f().load(u + x), y1) };
+        const Vec8f gp{ (y1 - kr * rp - kb * bp) * kg_rcp };
+
+        to_linear_avx2(rp, yuv.transfer).store(r + x);
+        to_linear_avx2(gp, yuv.transfer).store(g + x);
+        to_linear_avx2(bp, yuv.transfer).store(b + x);
+    }
+
+    if (width_mod8 < width)
+        yuv_to_rgb_row_c(y + width_mod8, u + width_mod8, v + width_mod8, r + width_mod8, g + width_mod8, b + width_mod8, yuv, width - width_mod8);
+}
+
+void rgb_to_yuv_row_avx2(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const Vec8f kr{ yuv.kr };
+    const Vec8f kb{ yuv.kb };
+    const Vec8f kg{ 1.0f - yuv.kr - yuv.kb };
+    const Vec8f cb_rcp{ 1.0f / (2.0f * (1.0f - yuv.kb)) };
+    const Vec8f cr_rcp{ 1.0f / (2.0f * (1.0f - yuv.kr)) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const Vec8f rp{ from_linear_avx2(Vec8f().load(r + x), yuv.transfer) };
+        const Vec8f gp{ from_linear_avx2(Vec8f().load(g + x), yuv.transfer) };
+        const Vec8f bp{ from_linear_avx2(Vec8f().load(b + x), yuv.transfer) };
+        const Vec8f y1{ kr * rp + kg * gp + kb * bp };
+
+        y1.store(y + x);
+        ((bp - y1) * cb_rcp).store(u + x);
+        ((rp - y1) * cr_rcp).store(v + x);
+    }
+
+    if (width_mod8 < width)
+        rgb_to_yuv_row_c(r + width_mod8, g + width_mod8, b + width_mod8, y + width_mod8, u + width_mod8, v + width_mod8, yuv, width - width_mod8);
+}
+
+void float_to_half_row_avx2(const float* src, uint16_t* __restrict dst, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm256_cvtps_ph(Vec8f().load(src + x), _MM_FROUND_TO_NEAREST_INT));
+
+    if (width_mod8 < width)
+        float_to_half_row_c(src + width_mod8, dst + width_mod8, width - width_mod8);
+}
+
+void half_to_float_row_avx2(const uint16_t* src, float* __restrict dst, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+        Vec8f(_mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x)))).store(dst + x);
+
+    if (width_mod8 < width)
+        half_to_float_row_c(src + width_mod8, dst + width_mod8, width - width_mod8);
+}
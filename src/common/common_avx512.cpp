@@ -7,6 +7,38 @@ void apply_matrix_avx512(const float matrix[3][3], const Vec16f input0, const Ve
     output2 = Vec16f(matrix[2][0]) * input0 + Vec16f(matrix[2][1]) * input1 + Vec16f(matrix[2][2]) * input2;
 }
 
+// log and exp with the AVX512 exponent/mantissa instructions and the polynomials of VCL2.
+// The inputs are finite, log is only used for x > 0 and exp under/overflows through scalef, so the special case handling is dropped.
+static inline Vec16f log_avx512(const Vec16f x0) noexcept
+{
+    // x = m * 2^e with m in sqrt(0.5)..sqrt(2)
+    Vec16f m{ _mm512_getmant_ps(x0, _MM_MANT_NORM_1_2, _MM_MANT_SIGN_zero) };
+    const __mmask16 blend{ _mm512_cmp_ps_mask(m, Vec16f(1.41421356f), _CMP_GT_OQ) };
+    m = _mm512_mask_mul_ps(m, blend, m, Vec16f(0.5f));
+    const Vec16f e{ _mm512_mask_add_ps(_mm512_getexp_ps(x0), blend, _mm512_getexp_ps(x0), Vec16f(1.0f)) };
+
+    const Vec16f x{ m - 1.0f };
+    const Vec16f x2{ x * x };
+    Vec16f res{ polynomial_8(x, 3.3333331174E-1f, -2.4999993993E-1f, 2.0000714765E-1f, -1.6668057665E-1f, 1.4249322787E-1f, -1.2420140846E-1f, 1.1676998740E-1f,
+        -1.1514610310E-1f, 7.0376836292E-2f) * (x2 * x) };
+
+    res = mul_add(e, -2.12194440E-4f, res);
+    res += nmul_add(x2, 0.5f, x);
+
+    return mul_add(e, 0.693359375f, res);
+}
+
+static inline Vec16f exp_avx512(const Vec16f x0) noexcept
+{
+    // x = n * ln2 + r with r in -ln2/2..ln2/2
+    const Vec16f n{ _mm512_roundscale_ps(x0 * 1.44269504f, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC) };
+    const Vec16f x{ nmul_add(n, -2.12194440e-4f, nmul_add(n, 0.693359375f, x0)) };
+
+    const Vec16f z{ mul_add(polynomial_5(x, 1.0f / 2.0f, 1.0f / 6.0f, 1.0f / 24.0f, 1.0f / 120.0f, 1.0f / 720.0f, 1.0f / 5040.0f), x * x, x) };
+
+    return _mm512_scalef_ps(z + 1.0f, n);
+}
+
 void rgb2lab_avx512(const Vec16f r, const Vec16f g, const Vec16f b, Vec16f& l_lab, Vec16f& a_lab, Vec16f& b_lab) noexcept
 {
     Vec16f l_lms;
@@ -18,9 +50,9 @@ void rgb2lab_avx512(const Vec16f r, const Vec16f g, const Vec16f b, Vec16f& l_la
     const Vec16f zero{ Vec16f(0.0f) };
     const Vec16f c{ Vec16f(-1024.0f) };
 
-    l_lms = select(l_lms > zero, log(l_lms), c);
-    m_lms = select(m_lms > zero, log(m_lms), c);
-    s_lms = select(s_lms > zero, log(s_lms), c);
+    l_lms = select(l_lms > zero, log_avx512(l_lms), c);
+    m_lms = select(m_lms > zero, log_avx512(m_lms), c);
+    s_lms = select(s_lms > zero, log_avx512(s_lms), c);
 
     apply_matrix_avx512(lms2lab, l_lms, m_lms, s_lms, l_lab, a_lab, b_lab);
 }
@@ -33,9 +65,342 @@ void lab2rgb_avx512(const Vec16f l_lab, const Vec16f a_lab, const Vec16f b_lab,
 
     apply_matrix_avx512(lab2lms, l_lab, a_lab, b_lab, l_lms, m_lms, s_lms);
 
-    l_lms = exp(l_lms);
-    m_lms = exp(m_lms);
-    s_lms = exp(s_lms);
+    l_lms = exp_avx512(l_lms);
+    m_lms = exp_avx512(m_lms);
+    s_lms = exp_avx512(s_lms);
 
     apply_matrix_avx512(lms2rgb, l_lms, m_lms, s_lms, r, g, b);
 }
+
+void convert_row_avx512(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+
+    Vec16f l1;
+    Vec16f a1;
+    Vec16f b1;
+    Vec16f a_acc{ zero_16f() };
+    Vec16f b_acc{ zero_16f() };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        rgb2lab_avx512(Vec16f().load(r + x), Vec16f().load(g + x), Vec16f().load(b + x), l1, a1, b1);
+
+        const int i{ lab_offset(x, lab_step) };
+        l1.store(l_lab + i);
+        a1.store(a_lab + i);
+        b1.store(b_lab + i);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod16 < width)
+    {
+        // the tail is shorter than a vector and never crosses a block
+        const int i{ lab_offset(width_mod16, lab_step) };
+        convert_row_c(r + width_mod16, g + width_mod16, b + width_mod16, l_lab + i, a_lab + i, b_lab + i, width - width_mod16, lab_step, a_sum, b_sum);
+    }
+}
+
+void correct_row_avx512(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+    const Vec16f avg_a{ avg.first };
+    const Vec16f avg_b{ avg.second };
+
+    Vec16f r1;
+    Vec16f g1;
+    Vec16f b1;
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        // subtract the average for the color channels and convert back to linear rgb
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 16)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_avx512(Vec16f().load(l_lab + i), Vec16f().load(a_lab + i) - avg_a, Vec16f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec16f(1.0f)), Vec16f(0.0f)).store(r + x);
+        max(min(g1, Vec16f(1.0f)), Vec16f(0.0f)).store(g + x);
+        max(min(b1, Vec16f(1.0f)), Vec16f(0.0f)).store(b + x);
+    }
+
+    if (width_mod16 < width)
+    {
+        const int i{ lab_offset(width_mod16, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod16, g + width_mod16, b + width_mod16, avg, width - width_mod16, lab_step, 0);
+    }
+}
+
+void convert_row_stream_avx512(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int head{ (lab_step == lab_block) ? stream_head<64>(l_lab, a_lab, b_lab, width) : -1 };
+    if (head < 0)
+    {
+        convert_row_avx512(r, g, b, l_lab, a_lab, b_lab, width, lab_step, a_sum, b_sum);
+        return;
+    }
+
+    convert_row_c(r, g, b, l_lab, a_lab, b_lab, head, lab_step, a_sum, b_sum);
+
+    const int width_mod16{ head + ((width - head) & ~15) };
+
+    Vec16f l1;
+    Vec16f a1;
+    Vec16f b1;
+    Vec16f a_acc{ zero_16f() };
+    Vec16f b_acc{ zero_16f() };
+
+    for (int x{ head }; x < width_mod16; x += 16)
+    {
+        rgb2lab_avx512(Vec16f().load(r + x), Vec16f().load(g + x), Vec16f().load(b + x), l1, a1, b1);
+
+        l1.store_nt(l_lab + x);
+        a1.store_nt(a_lab + x);
+        b1.store_nt(b_lab + x);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod16 < width)
+        convert_row_c(r + width_mod16, g + width_mod16, b + width_mod16, l_lab + width_mod16, a_lab + width_mod16, b_lab + width_mod16, width - width_mod16, lab_step, a_sum, b_sum);
+
+    _mm_sfence();
+}
+
+void correct_row_stream_avx512(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    // a head would shift the vectors across the blocks of the interleaved layout
+    const int head{ stream_head<64>(r, g, b, width) };
+    if (head < 0 || (head > 0 && lab_step != lab_block))
+    {
+        correct_row_avx512(l_lab, a_lab, b_lab, r, g, b, avg, width, lab_step, prefetch);
+        return;
+    }
+
+    correct_row_c(l_lab, a_lab, b_lab, r, g, b, avg, head, lab_step, 0);
+
+    const int width_mod16{ head + ((width - head) & ~15) };
+    const Vec16f avg_a{ avg.first };
+    const Vec16f avg_b{ avg.second };
+
+    Vec16f r1;
+    Vec16f g1;
+    Vec16f b1;
+
+    for (int x{ head }; x < width_mod16; x += 16)
+    {
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 16)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_avx512(Vec16f().load(l_lab + i), Vec16f().load(a_lab + i) - avg_a, Vec16f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec16f(1.0f)), Vec16f(0.0f)).store_nt(r + x);
+        max(min(g1, Vec16f(1.0f)), Vec16f(0.0f)).store_nt(g + x);
+        max(min(b1, Vec16f(1.0f)), Vec16f(0.0f)).store_nt(b + x);
+    }
+
+    if (width_mod16 < width)
+    {
+        const int i{ lab_offset(width_mod16, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod16, g + width_mod16, b + width_mod16, avg, width - width_mod16, lab_step, 0);
+    }
+
+    _mm_sfence();
+}
+
+void unpack_rgb24_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each load reads 64 bytes but uses 48, keep the last load inside the row
+    const int width_mod16{ std::max(width - 6, 0) & ~15 };
+    const Vec16f scale{ 1.0f / 255.0f };
+    const Vec16ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16ui px{ Vec16ui(permute64<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1, 15, 16, 17, -1, 18, 19, 20, -1, 21, 22, 23, -1, 24, 25, 26, -1, 27, 28, 29, -1, 30, 31, 32, -1, 33, 34, 35, -1, 36, 37, 38, -1, 39, 40, 41, -1, 42, 43, 44, -1, 45, 46, 47, -1>(Vec64uc().load(src + x * 3))) };
+
+        (to_float(Vec16i(px & mask)) * scale).store(b + x);
+        (to_float(Vec16i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec16i(px >> 16)) * scale).store(r + x);
+    }
+
+    unpack_rgb24_row_c(src + width_mod16 * 3, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+void unpack_rgb32_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+    const Vec16f scale{ 1.0f / 255.0f };
+    const Vec16ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16ui px{ Vec16ui().load(src + x * 4) };
+
+        (to_float(Vec16i(px & mask)) * scale).store(b + x);
+        (to_float(Vec16i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec16i((px >> 16) & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb32_row_c(src + width_mod16 * 4, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+void unpack_rgb48_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each half of the pixels is loaded with 64 bytes but uses 48, keep the last load inside the row
+    const int width_mod16{ std::max(width - 3, 0) & ~15 };
+    const Vec16f scale{ 1.0f / 65535.0f };
+    const Vec16ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16ui p0{ Vec16ui(permute32<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1, 15, 16, 17, -1, 18, 19, 20, -1, 21, 22, 23, -1>(Vec32us().load(src + x * 6))) };
+        const Vec16ui p1{ Vec16ui(permute32<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 12, 13, 14, -1, 15, 16, 17, -1, 18, 19, 20, -1, 21, 22, 23, -1>(Vec32us().load(src + x * 6 + 48))) };
+        const Vec16ui lo{ blend16<0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30>(p0, p1) };
+        const Vec16ui hi{ blend16<1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31>(p0, p1) };
+
+        (to_float(Vec16i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec16i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec16i(hi)) * scale).store(r + x);
+    }
+
+    unpack_rgb48_row_c(src + width_mod16 * 6, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+void unpack_rgb64_row_avx512(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+    const Vec16f scale{ 1.0f / 65535.0f };
+    const Vec16ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16ui p0{ Vec16ui().load(src + x * 8) };
+        const Vec16ui p1{ Vec16ui().load(src + x * 8 + 64) };
+        const Vec16ui lo{ blend16<0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30>(p0, p1) };
+        const Vec16ui hi{ blend16<1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31>(p0, p1) };
+
+        (to_float(Vec16i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec16i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec16i(hi & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb64_row_c(src + width_mod16 * 8, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+static inline Vec16f to_linear_avx512(const Vec16f v0, const grayworld_transfer transfer) noexcept
+{
+    const Vec16f v{ max(min(v0, Vec16f(1.0f)), Vec16f(0.0f)) };
+
+    if (transfer == grayworld_transfer::bt709)
+        return select(v < Vec16f(0.081f), v * (1.0f / 4.5f), pow((v + 0.099f) * (1.0f / 1.099f), 1.0f / 0.45f));
+
+    const Vec16f p{ pow(v, 1.0f / pq_m2) };
+    return pow(max(p - pq_c1, Vec16f(0.0f)) / (Vec16f(pq_c2) - pq_c3 * p), 1.0f / pq_m1);
+}
+
+static inline Vec16f from_linear_avx512(const Vec16f l, const grayworld_transfer transfer) noexcept
+{
+    if (transfer == grayworld_transfer::bt709)
+        return select(l < Vec16f(0.018f), l * 4.5f, 1.099f * pow(l, 0.45f) - 0.099f);
+
+    const Vec16f p{ pow(l, pq_m1) };
+    return pow((pq_c1 + pq_c2 * p) / (1.0f + pq_c3 * p), pq_m2);
+}
+
+void yuv_to_rgb_row_avx512(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+    const Vec16f cr{ 2.0f * (1.0f - yuv.kr) };
+    const Vec16f cb{ 2.0f * (1.0f - yuv.kb) };
+    const Vec16f kr{ yuv.kr };
+    const Vec16f kb{ yuv.kb };
+    const Vec16f kg_rcp{ 1.0f / (1.0f - yuv.kr - yuv.kb) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16f y1{ Vec16f().load(y + x) };
+        const Vec16f rp{ mul_add(cr, Vec16f().load(v + x), y1) };
+        const Vec16f bp{ mul_add(cb, Vec16f().load(u + x), y1) };
+        const Vec16f gp{ (y1 - kr * rp - kb * bp) * kg_rcp };
+
+        to_linear_avx512(rp, yuv.transfer).store(r + x);
+        to_linear_avx512(gp, yuv.transfer).store(g + x);
+        to_linear_avx512(bp, yuv.transfer).store(b + x);
+    }
+
+    if (width_mod16 < width)
+        yuv_to_rgb_row_c(y + width_mod16, u + width_mod16, v + width_mod16, r + width_mod16, g + width_mod16, b + width_mod16, yuv, width - width_mod16);
+}
+
+void rgb_to_yuv_row_avx512(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+    const Vec16f kr{ yuv.kr };
+    const Vec16f kb{ yuv.kb };
+    const Vec16f kg{ 1.0f - yuv.kr - yuv.kb };
+    const Vec16f cb_rcp{ 1.0f / (2.0f * (1.0f - yuv.kb)) };
+    const Vec16f cr_rcp{ 1.0f / (2.0f * (1.0f - yuv.kr)) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const Vec16f rp{ from_linear_avx512(Vec16f().load(r + x), yuv.transfer) };
+        const Vec16f gp{ from_linear_avx512(Vec16f().load(g + x), yuv.transfer) };
+        const Vec16f bp{ from_linear_avx512(Vec16f().load(b + x), yuv.transfer) };
+        const Vec16f y1{ kr * rp + kg * gp + kb * bp };
+
+        y1.store(y + x);
+        ((bp - y1) * cb_rcp).store(u + x);
+        ((rp - y1) * cr_rcp).store(v + x);
+    }
+
+    if (width_mod16 < width)
+        rgb_to_yuv_row_c(r + width_mod16, g + width_mod16, b + width_mod16, y + width_mod16, u + width_mod16, v + width_mod16, yuv, width - width_mod16);
+}
+
+void float_to_half_row_avx512(const float* src, uint16_t* __restrict dst, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm512_cvtps_ph(Vec16f().load(src + x), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+
+    if (width_mod16 < width)
+        float_to_half_row_c(src + width_mod16, dst + width_mod16, width - width_mod16);
+}
+
+void half_to_float_row_avx512(const uint16_t* src, float* __restrict dst, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+        Vec16f(_mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x)))).store(dst + x);
+
+    if (width_mod16 < width)
+        half_to_float_row_c(src + width_mod16, dst + width_mod16, width - width_mod16);
+}
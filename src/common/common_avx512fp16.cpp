@@ -0,0 +1,348 @@
+#include <type_traits>
+
+#include "../common/common.h"
+#include "../VCL2/vectorclass.h"
+
+// The range reduction and the reconstruction are done in fp32, only the small high order terms of the log/exp
+// polynomials are evaluated on 32 halves. The max error of the output is about 1e-3, like with the fp16 LAB scratch.
+
+static inline __m512h to_half_avx512fp16(const Vec16f x0, const Vec16f x1) noexcept
+{
+    const __m512i lo{ _mm512_castsi256_si512(_mm512_cvtps_ph(x0, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)) };
+
+    return _mm512_castsi512_ph(_mm512_inserti64x4(lo, _mm512_cvtps_ph(x1, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC), 1));
+}
+
+static inline void to_float_avx512fp16(const __m512h h, Vec16f& x0, Vec16f& x1) noexcept
+{
+    const __m512i i{ _mm512_castph_si512(h) };
+
+    x0 = _mm512_cvtph_ps(_mm512_castsi512_si256(i));
+    x1 = _mm512_cvtph_ps(_mm512_extracti64x4_epi64(i, 1));
+}
+
+// Half precision bits of a normal constant, evaluated at compile time.
+static constexpr uint16_t half_bits(float v) noexcept
+{
+    const uint16_t sign{ static_cast<uint16_t>((v < 0.0f) ? 0x8000 : 0) };
+    int e{ 15 };
+
+    v = (v < 0.0f) ? -v : v;
+
+    while (v >= 2.0f)
+    {
+        v *= 0.5f;
+        ++e;
+    }
+    while (v < 1.0f)
+    {
+        v *= 2.0f;
+        --e;
+    }
+
+    // round to nearest even
+    const float m{ (v - 1.0f) * 1024.0f };
+    uint32_t mi{ static_cast<uint32_t>(m) };
+    if (m - mi > 0.5f || (m - mi == 0.5f && (mi & 1)))
+        ++mi;
+
+    return static_cast<uint16_t>(sign | ((e << 10) + mi));
+}
+
+#define SET1_HALF(v) _mm512_castsi512_ph(_mm512_set1_epi16(static_cast<short>(std::integral_constant<uint16_t, half_bits(v)>::value)))
+
+static inline void apply_matrix_avx512fp16(const float matrix[3][3], const Vec16f input0, const Vec16f input1, const Vec16f input2, Vec16f& output0, Vec16f& output1, Vec16f& output2) noexcept
+{
+    output0 = Vec16f(matrix[0][0]) * input0 + Vec16f(matrix[0][1]) * input1 + Vec16f(matrix[0][2]) * input2;
+    output1 = Vec16f(matrix[1][0]) * input0 + Vec16f(matrix[1][1]) * input1 + Vec16f(matrix[1][2]) * input2;
+    output2 = Vec16f(matrix[2][0]) * input0 + Vec16f(matrix[2][1]) * input1 + Vec16f(matrix[2][2]) * input2;
+}
+
+// x = m * 2^e with m in 0.75..1.5 and f = m - 1. With s = f / (f + 2) in -0.143..0.2:
+// log(m) = 2 * atanh(s) = f - s * (f - s^2 * (2/3 + 2/5 * s^2)), only the second term is evaluated in half precision.
+static inline void log_avx512fp16(Vec16f x[2]) noexcept
+{
+    Vec16f f[2];
+    Vec16f e[2];
+
+    for (int i{ 0 }; i < 2; ++i)
+    {
+        const Vec16f m{ _mm512_getmant_ps(x[i], _MM_MANT_NORM_p75_1p5, _MM_MANT_SIGN_zero) };
+        e[i] = _mm512_mask_add_ps(_mm512_getexp_ps(x[i]), _mm512_cmp_ps_mask(m, Vec16f(1.0f), _CMP_LT_OQ), _mm512_getexp_ps(x[i]), Vec16f(1.0f));
+        f[i] = m - 1.0f;
+    }
+
+    const __m512h fh{ to_half_avx512fp16(f[0], f[1]) };
+    const __m512h s{ _mm512_mul_ph(fh, _mm512_rcp_ph(_mm512_add_ph(fh, SET1_HALF(2.0f)))) };
+    const __m512h s2{ _mm512_mul_ph(s, s) };
+    const __m512h t{ _mm512_mul_ph(s, _mm512_fnmadd_ph(s2, _mm512_fmadd_ph(s2, SET1_HALF(2.0f / 5.0f), SET1_HALF(2.0f / 3.0f)), fh)) };
+
+    Vec16f t1[2];
+    to_float_avx512fp16(t, t1[0], t1[1]);
+
+    x[0] = mul_add(e[0], Vec16f(0.693147181f), f[0] - t1[0]);
+    x[1] = mul_add(e[1], Vec16f(0.693147181f), f[1] - t1[1]);
+}
+
+// exp(x) = 2^n * exp(r) with r in -0.347..0.347 and exp(r) = 1 + r + r^2 * (1/2 + r/6 + r^2/24),
+// only the last term is evaluated in half precision.
+static inline void exp_avx512fp16(Vec16f x[2]) noexcept
+{
+    Vec16f n[2];
+    Vec16f r[2];
+
+    for (int i{ 0 }; i < 2; ++i)
+    {
+        n[i] = round(x[i] * 1.44269504f);
+        r[i] = nmul_add(n[i], Vec16f(-2.12194440e-4f), nmul_add(n[i], Vec16f(0.693359375f), x[i]));
+    }
+
+    const __m512h rh{ to_half_avx512fp16(r[0], r[1]) };
+    const __m512h t{ _mm512_mul_ph(_mm512_mul_ph(rh, rh), _mm512_fmadd_ph(_mm512_fmadd_ph(SET1_HALF(1.0f / 24.0f), rh, SET1_HALF(1.0f / 6.0f)), rh, SET1_HALF(0.5f))) };
+
+    Vec16f t1[2];
+    to_float_avx512fp16(t, t1[0], t1[1]);
+
+    x[0] = _mm512_scalef_ps(r[0] + t1[0] + 1.0f, n[0]);
+    x[1] = _mm512_scalef_ps(r[1] + t1[1] + 1.0f, n[1]);
+}
+
+static inline void rgb2lab_avx512fp16(const Vec16f r[2], const Vec16f g[2], const Vec16f b[2], Vec16f l_lab[2], Vec16f a_lab[2], Vec16f b_lab[2]) noexcept
+{
+    Vec16f l_lms[2];
+    Vec16f m_lms[2];
+    Vec16f s_lms[2];
+
+    for (int i{ 0 }; i < 2; ++i)
+        apply_matrix_avx512fp16(rgb2lms, r[i], g[i], b[i], l_lms[i], m_lms[i], s_lms[i]);
+
+    const Vec16f zero{ Vec16f(0.0f) };
+    const Vec16f c{ Vec16f(-1024.0f) };
+    const Vec16f l0[2]{ l_lms[0], l_lms[1] };
+    const Vec16f m0[2]{ m_lms[0], m_lms[1] };
+    const Vec16f s0[2]{ s_lms[0], s_lms[1] };
+
+    log_avx512fp16(l_lms);
+    log_avx512fp16(m_lms);
+    log_avx512fp16(s_lms);
+
+    for (int i{ 0 }; i < 2; ++i)
+    {
+        l_lms[i] = select(l0[i] > zero, l_lms[i], c);
+        m_lms[i] = select(m0[i] > zero, m_lms[i], c);
+        s_lms[i] = select(s0[i] > zero, s_lms[i], c);
+
+        apply_matrix_avx512fp16(lms2lab, l_lms[i], m_lms[i], s_lms[i], l_lab[i], a_lab[i], b_lab[i]);
+    }
+}
+
+static inline void lab2rgb_avx512fp16(const Vec16f l_lab[2], const Vec16f a_lab[2], const Vec16f b_lab[2], Vec16f r[2], Vec16f g[2], Vec16f b[2]) noexcept
+{
+    Vec16f l_lms[2];
+    Vec16f m_lms[2];
+    Vec16f s_lms[2];
+
+    for (int i{ 0 }; i < 2; ++i)
+        apply_matrix_avx512fp16(lab2lms, l_lab[i], a_lab[i], b_lab[i], l_lms[i], m_lms[i], s_lms[i]);
+
+    exp_avx512fp16(l_lms);
+    exp_avx512fp16(m_lms);
+    exp_avx512fp16(s_lms);
+
+    for (int i{ 0 }; i < 2; ++i)
+        apply_matrix_avx512fp16(lms2rgb, l_lms[i], m_lms[i], s_lms[i], r[i], g[i], b[i]);
+}
+
+void convert_row_avx512fp16(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int width_mod32{ width - (width % 32) };
+
+    Vec16f l1[2];
+    Vec16f a1[2];
+    Vec16f b1[2];
+    Vec16f a_acc{ zero_16f() };
+    Vec16f b_acc{ zero_16f() };
+
+    for (int x{ 0 }; x < width_mod32; x += 32)
+    {
+        const Vec16f r1[2]{ Vec16f().load(r + x), Vec16f().load(r + x + 16) };
+        const Vec16f g1[2]{ Vec16f().load(g + x), Vec16f().load(g + x + 16) };
+        const Vec16f b0[2]{ Vec16f().load(b + x), Vec16f().load(b + x + 16) };
+
+        rgb2lab_avx512fp16(r1, g1, b0, l1, a1, b1);
+
+        // the two halves are in consecutive blocks of the interleaved layout
+        for (int i{ 0 }; i < 2; ++i)
+        {
+            const int j{ lab_offset(x + i * 16, lab_step) };
+            l1[i].store(l_lab + j);
+            a1[i].store(a_lab + j);
+            b1[i].store(b_lab + j);
+
+            a_acc += a1[i];
+            b_acc += b1[i];
+        }
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    // the fp32 kernel handles the last 16..31 pixels, width_mod32 is a block boundary
+    if (width_mod32 < width)
+    {
+        const int i{ lab_offset(width_mod32, lab_step) };
+        convert_row_avx512(r + width_mod32, g + width_mod32, b + width_mod32, l_lab + i, a_lab + i, b_lab + i, width - width_mod32, lab_step, a_sum, b_sum);
+    }
+}
+
+void correct_row_avx512fp16(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    const int width_mod32{ width - (width % 32) };
+    const Vec16f avg_a{ avg.first };
+    const Vec16f avg_b{ avg.second };
+
+    Vec16f r1[2];
+    Vec16f g1[2];
+    Vec16f b1[2];
+
+    for (int x{ 0 }; x < width_mod32; x += 32)
+    {
+        const int i0{ lab_offset(x, lab_step) };
+        const int i1{ lab_offset(x + 16, lab_step) };
+
+        // every vector covers two blocks
+        if (prefetch)
+        {
+            for (const int pi : { lab_offset(x + prefetch, lab_step), lab_offset(x + prefetch + 16, lab_step) })
+            {
+                _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+                _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+                _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+            }
+        }
+
+        const Vec16f l0[2]{ Vec16f().load(l_lab + i0), Vec16f().load(l_lab + i1) };
+        const Vec16f a0[2]{ Vec16f().load(a_lab + i0) - avg_a, Vec16f().load(a_lab + i1) - avg_a };
+        const Vec16f b0[2]{ Vec16f().load(b_lab + i0) - avg_b, Vec16f().load(b_lab + i1) - avg_b };
+
+        lab2rgb_avx512fp16(l0, a0, b0, r1, g1, b1);
+
+        for (int i{ 0 }; i < 2; ++i)
+        {
+            max(min(r1[i], Vec16f(1.0f)), Vec16f(0.0f)).store(r + x + i * 16);
+            max(min(g1[i], Vec16f(1.0f)), Vec16f(0.0f)).store(g + x + i * 16);
+            max(min(b1[i], Vec16f(1.0f)), Vec16f(0.0f)).store(b + x + i * 16);
+        }
+    }
+
+    if (width_mod32 < width)
+    {
+        const int i{ lab_offset(width_mod32, lab_step) };
+        correct_row_avx512(l_lab + i, a_lab + i, b_lab + i, r + width_mod32, g + width_mod32, b + width_mod32, avg, width - width_mod32, lab_step, 0);
+    }
+}
+
+void convert_row_stream_avx512fp16(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int head{ (lab_step == lab_block) ? stream_head<64>(l_lab, a_lab, b_lab, width) : -1 };
+    if (head < 0)
+    {
+        convert_row_avx512fp16(r, g, b, l_lab, a_lab, b_lab, width, lab_step, a_sum, b_sum);
+        return;
+    }
+
+    convert_row_c(r, g, b, l_lab, a_lab, b_lab, head, lab_step, a_sum, b_sum);
+
+    const int width_mod32{ head + ((width - head) & ~31) };
+
+    Vec16f l1[2];
+    Vec16f a1[2];
+    Vec16f b1[2];
+    Vec16f a_acc{ zero_16f() };
+    Vec16f b_acc{ zero_16f() };
+
+    for (int x{ head }; x < width_mod32; x += 32)
+    {
+        const Vec16f r1[2]{ Vec16f().load(r + x), Vec16f().load(r + x + 16) };
+        const Vec16f g1[2]{ Vec16f().load(g + x), Vec16f().load(g + x + 16) };
+        const Vec16f b0[2]{ Vec16f().load(b + x), Vec16f().load(b + x + 16) };
+
+        rgb2lab_avx512fp16(r1, g1, b0, l1, a1, b1);
+
+        for (int i{ 0 }; i < 2; ++i)
+        {
+            l1[i].store_nt(l_lab + x + i * 16);
+            a1[i].store_nt(a_lab + x + i * 16);
+            b1[i].store_nt(b_lab + x + i * 16);
+
+            a_acc += a1[i];
+            b_acc += b1[i];
+        }
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod32 < width)
+        convert_row_stream_avx512(r + width_mod32, g + width_mod32, b + width_mod32, l_lab + width_mod32, a_lab + width_mod32, b_lab + width_mod32, width - width_mod32, lab_step, a_sum, b_sum);
+
+    _mm_sfence();
+}
+
+void correct_row_stream_avx512fp16(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    // a head would shift the vectors across the blocks of the interleaved layout
+    const int head{ stream_head<64>(r, g, b, width) };
+    if (head < 0 || (head > 0 && lab_step != lab_block))
+    {
+        correct_row_avx512fp16(l_lab, a_lab, b_lab, r, g, b, avg, width, lab_step, prefetch);
+        return;
+    }
+
+    correct_row_c(l_lab, a_lab, b_lab, r, g, b, avg, head, lab_step, 0);
+
+    const int width_mod32{ head + ((width - head) & ~31) };
+    const Vec16f avg_a{ avg.first };
+    const Vec16f avg_b{ avg.second };
+
+    Vec16f r1[2];
+    Vec16f g1[2];
+    Vec16f b1[2];
+
+    for (int x{ head }; x < width_mod32; x += 32)
+    {
+        const int i0{ lab_offset(x, lab_step) };
+        const int i1{ lab_offset(x + 16, lab_step) };
+
+        if (prefetch)
+        {
+            for (const int pi : { lab_offset(x + prefetch, lab_step), lab_offset(x + prefetch + 16, lab_step) })
+            {
+                _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+                _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+                _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+            }
+        }
+
+        const Vec16f l0[2]{ Vec16f().load(l_lab + i0), Vec16f().load(l_lab + i1) };
+        const Vec16f a0[2]{ Vec16f().load(a_lab + i0) - avg_a, Vec16f().load(a_lab + i1) - avg_a };
+        const Vec16f b0[2]{ Vec16f().load(b_lab + i0) - avg_b, Vec16f().load(b_lab + i1) - avg_b };
+
+        lab2rgb_avx512fp16(l0, a0, b0, r1, g1, b1);
+
+        for (int i{ 0 }; i < 2; ++i)
+        {
+            max(min(r1[i], Vec16f(1.0f)), Vec16f(0.0f)).store_nt(r + x + i * 16);
+            max(min(g1[i], Vec16f(1.0f)), Vec16f(0.0f)).store_nt(g + x + i * 16);
+            max(min(b1[i], Vec16f(1.0f)), Vec16f(0.0f)).store_nt(b + x + i * 16);
+        }
+    }
+
+    if (width_mod32 < width)
+    {
+        const int i{ lab_offset(width_mod32, lab_step) };
+        correct_row_stream_avx512(l_lab + i, a_lab + i, b_lab + i, r + width_mod32, g + width_mod32, b + width_mod32, avg, width - width_mod32, lab_step, 0);
+    }
+
+    _mm_sfence();
+}
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstring>
 
 #include "common.h"
 
@@ -35,47 +36,216 @@ void lab2rgb_c(const float lab[3], float rgb[3]) noexcept
     apply_matrix_c(lms2rgb, lms, rgb);
 }
 
-template <grayworld_mode mode>
-std::pair<float, float> compute_correction(float* line_sum, int* line_count_pels, const int height) noexcept
+void convert_row_c(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
 {
-    if constexpr (mode == grayworld_mode::mean)
+    float rgb[3];
+    float lab[3];
+
+    for (int x{ 0 }; x < width; ++x)
     {
-        float asum{ 0.0f };
-        float bsum{ 0.0f };
-        int pixels{ 0 };
-
-        for (int y{ 0 }; y < height; ++y)
-        {
-            asum += line_sum[y];
-            bsum += line_sum[y + height];
-            pixels += line_count_pels[y];
-        }
-
-        return std::make_pair<float, float>(asum / pixels, bsum / pixels);
+        rgb[0] = r[x];
+        rgb[1] = g[x];
+        rgb[2] = b[x];
+
+        rgb2lab_c(rgb, lab);
+
+        const int i{ lab_offset(x, lab_step) };
+        l_lab[i] = lab[0];
+        a_lab[i] = lab[1];
+        b_lab[i] = lab[2];
+
+        a_sum += lab[1];
+        b_sum += lab[2];
     }
-    else
+}
+
+void correct_row_c(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, [[maybe_unused]] const int prefetch) noexcept
+{
+    float rgb[3];
+    float lab[3];
+
+    for (int x{ 0 }; x < width; ++x)
+    {
+        const int i{ lab_offset(x, lab_step) };
+        lab[0] = l_lab[i];
+        // subtract the average for the color channels
+        lab[1] = a_lab[i] - avg.first;
+        lab[2] = b_lab[i] - avg.second;
+
+        //convert back to linear rgb
+        lab2rgb_c(lab, rgb);
+        r[x] = std::clamp(rgb[0], 0.0f, 1.0f);
+        g[x] = std::clamp(rgb[1], 0.0f, 1.0f);
+        b[x] = std::clamp(rgb[2], 0.0f, 1.0f);
+    }
+}
+
+void unpack_rgb24_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    for (int x{ 0 }; x < width; ++x)
+    {
+        b[x] = src[x * 3] * (1.0f / 255.0f);
+        g[x] = src[x * 3 + 1] * (1.0f / 255.0f);
+        r[x] = src[x * 3 + 2] * (1.0f / 255.0f);
+    }
+}
+
+void unpack_rgb32_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    for (int x{ 0 }; x < width; ++x)
+    {
+        b[x] = src[x * 4] * (1.0f / 255.0f);
+        g[x] = src[x * 4 + 1] * (1.0f / 255.0f);
+        r[x] = src[x * 4 + 2] * (1.0f / 255.0f);
+    }
+}
+
+void unpack_rgb48_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const uint16_t* s{ reinterpret_cast<const uint16_t*>(src) };
+
+    for (int x{ 0 }; x < width; ++x)
+    {
+        b[x] = s[x * 3] * (1.0f / 65535.0f);
+        g[x] = s[x * 3 + 1] * (1.0f / 65535.0f);
+        r[x] = s[x * 3 + 2] * (1.0f / 65535.0f);
+    }
+}
+
+void unpack_rgb64_row_c(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const uint16_t* s{ reinterpret_cast<const uint16_t*>(src) };
+
+    for (int x{ 0 }; x < width; ++x)
+    {
+        b[x] = s[x * 4] * (1.0f / 65535.0f);
+        g[x] = s[x * 4 + 1] * (1.0f / 65535.0f);
+        r[x] = s[x * 4 + 2] * (1.0f / 65535.0f);
+    }
+}
+
+static float to_linear_c(float v, const grayworld_transfer transfer) noexcept
+{
+    v = std::clamp(v, 0.0f, 1.0f);
+
+    if (transfer == grayworld_transfer::bt709)
+        return (v < 0.081f) ? v / 4.5f : powf((v + 0.099f) / 1.099f, 1.0f / 0.45f);
+
+    const float p{ powf(v, 1.0f / pq_m2) };
+    return powf(std::max(p - pq_c1, 0.0f) / (pq_c2 - pq_c3 * p), 1.0f / pq_m1);
+}
+
+static float from_linear_c(const float l, const grayworld_transfer transfer) noexcept
+{
+    if (transfer == grayworld_transfer::bt709)
+        return (l < 0.018f) ? l * 4.5f : 1.099f * powf(l, 0.45f) - 0.099f;
+
+    const float p{ powf(l, pq_m1) };
+    return powf((pq_c1 + pq_c2 * p) / (1.0f + pq_c3 * p), pq_m2);
+}
+
+void yuv_to_rgb_row_c(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const float kg{ 1.0f - yuv.kr - yuv.kb };
+
+    for (int x{ 0 }; x < width; ++x)
     {
-        std::vector<float> am;
-        am.reserve(height);
-        std::vector<float> bm;
-        bm.reserve(height);
+        const float rp{ y[x] + 2.0f * (1.0f - yuv.kr) * v[x] };
+        const float bp{ y[x] + 2.0f * (1.0f - yuv.kb) * u[x] };
+        const float gp{ (y[x] - yuv.kr * rp - yuv.kb * bp) / kg };
 
-        for (int y{ 0 }; y < height; ++y)
-        {
-            am.emplace_back(line_sum[y]);
-            bm.emplace_back(line_sum[y + height]);
-        }
+        r[x] = to_linear_c(rp, yuv.transfer);
+        g[x] = to_linear_c(gp, yuv.transfer);
+        b[x] = to_linear_c(bp, yuv.transfer);
+    }
+}
 
-        const auto middleItr{ am.begin() + am.size() / 2 };
-        std::nth_element(am.begin(), middleItr, am.end());
+void rgb_to_yuv_row_c(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const float kg{ 1.0f - yuv.kr - yuv.kb };
 
-        const auto middleItr1{ bm.begin() + bm.size() / 2 };
-        std::nth_element(bm.begin(), middleItr1, bm.end());
+    for (int x{ 0 }; x < width; ++x)
+    {
+        const float rp{ from_linear_c(r[x], yuv.transfer) };
+        const float gp{ from_linear_c(g[x], yuv.transfer) };
+        const float bp{ from_linear_c(b[x], yuv.transfer) };
 
-        return std::make_pair<float, float>((am.size() % 2 == 0) ? ((*(std::max_element(am.begin(), middleItr)) + *middleItr) / 2) : *middleItr,
-            (bm.size() % 2 == 0) ? ((*(std::max_element(bm.begin(), middleItr1)) + *middleItr1) / 2) : *middleItr1);
+        y[x] = yuv.kr * rp + kg * gp + yuv.kb * bp;
+        u[x] = (bp - y[x]) / (2.0f * (1.0f - yuv.kb));
+        v[x] = (rp - y[x]) / (2.0f * (1.0f - yuv.kr));
     }
 }
 
-template std::pair<float, float> compute_correction<grayworld_mode::mean>(float* line_sum, int* line_count_pels, const int height) noexcept;
-template std::pair<float, float> compute_correction<grayworld_mode::median>(float* line_sum, int* line_count_pels, const int height) noexcept;
+static uint16_t float_to_half(const float f) noexcept
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+
+    const uint16_t sign{ static_cast<uint16_t>((x >> 16) & 0x8000) };
+    x &= 0x7FFFFFFF;
+
+    // inf/nan
+    if (x >= 0x7F800000)
+        return sign | 0x7C00 | ((x > 0x7F800000) ? 0x200 : 0);
+    // rounds to inf
+    if (x >= 0x477FF000)
+        return sign | 0x7C00;
+    // subnormal or zero
+    if (x < 0x38800000)
+    {
+        if (x <= 0x33000000)
+            return sign;
+
+        const int shift{ 126 - static_cast<int>(x >> 23) };
+        const uint32_t mant{ (x & 0x7FFFFF) | 0x800000 };
+        const uint32_t rem{ mant & ((1u << shift) - 1) };
+        const uint32_t halfway{ 1u << (shift - 1) };
+        uint32_t h{ mant >> shift };
+
+        if (rem > halfway || (rem == halfway && (h & 1)))
+            ++h;
+
+        return sign | static_cast<uint16_t>(h);
+    }
+
+    x -= 0x38000000;
+    x += 0x0FFF + ((x >> 13) & 1);
+
+    return sign | static_cast<uint16_t>(x >> 13);
+}
+
+static float half_to_float(const uint16_t h) noexcept
+{
+    const uint32_t sign{ static_cast<uint32_t>(h & 0x8000) << 16 };
+    const uint32_t exp{ static_cast<uint32_t>((h >> 10) & 0x1F) };
+    const uint32_t mant{ h & 0x3FFu };
+    uint32_t x;
+
+    if (exp == 0)
+    {
+        const float f{ mant * (1.0f / 16777216.0f) };
+        std::memcpy(&x, &f, sizeof(x));
+        x |= sign;
+    }
+    else if (exp == 31)
+        x = sign | 0x7F800000 | (mant << 13);
+    else
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+
+    return f;
+}
+
+void float_to_half_row_c(const float* src, uint16_t* __restrict dst, const int width) noexcept
+{
+    for (int x{ 0 }; x < width; ++x)
+        dst[x] = float_to_half(src[x]);
+}
+
+void half_to_float_row_c(const uint16_t* src, float* __restrict dst, const int width) noexcept
+{
+    for (int x{ 0 }; x < width; ++x)
+        dst[x] = half_to_float(src[x]);
+}
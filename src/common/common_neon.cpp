@@ -0,0 +1,377 @@
+#include <arm_neon.h>
+
+#include "common.h"
+
+static inline void apply_matrix_neon(const float matrix[3][3], const float32x4_t input0, const float32x4_t input1, const float32x4_t input2, float32x4_t& output0, float32x4_t& output1,
+    float32x4_t& output2) noexcept
+{
+    output0 = vfmaq_n_f32(vfmaq_n_f32(vmulq_n_f32(input0, matrix[0][0]), input1, matrix[0][1]), input2, matrix[0][2]);
+    output1 = vfmaq_n_f32(vfmaq_n_f32(vmulq_n_f32(input0, matrix[1][0]), input1, matrix[1][1]), input2, matrix[1][2]);
+    output2 = vfmaq_n_f32(vfmaq_n_f32(vmulq_n_f32(input0, matrix[2][0]), input1, matrix[2][1]), input2, matrix[2][2]);
+}
+
+// c0 + c1 * x, the building block of the VCL2 polynomials
+static inline float32x4_t mul_add_neon(const float c1, const float32x4_t x, const float c0) noexcept
+{
+    return vfmaq_n_f32(vdupq_n_f32(c0), x, c1);
+}
+
+// log and exp with the polynomials of VCL2 (the same as the x86 code).
+// The inputs are finite and log is only used for x > 0, so the special case handling is dropped.
+static inline float32x4_t log_neon(const float32x4_t x0) noexcept
+{
+    // x = m * 2^e with m in sqrt(0.5)..sqrt(2)
+    const uint32x4_t bits{ vreinterpretq_u32_f32(x0) };
+    float32x4_t m{ vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007FFFFF)), vdupq_n_u32(0x3F800000))) };
+    float32x4_t e{ vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(127))) };
+
+    const uint32x4_t blend{ vcgtq_f32(m, vdupq_n_f32(1.41421356f)) };
+    m = vbslq_f32(blend, vmulq_n_f32(m, 0.5f), m);
+    e = vbslq_f32(blend, vaddq_f32(e, vdupq_n_f32(1.0f)), e);
+
+    const float32x4_t x{ vsubq_f32(m, vdupq_n_f32(1.0f)) };
+    const float32x4_t x2{ vmulq_f32(x, x) };
+    const float32x4_t x4{ vmulq_f32(x2, x2) };
+    const float32x4_t x8{ vmulq_f32(x4, x4) };
+
+    // polynomial_8
+    const float32x4_t lo{ vfmaq_f32(vfmaq_n_f32(mul_add_neon(-2.4999993993E-1f, x, 3.3333331174E-1f), x8, 7.0376836292E-2f), x2, mul_add_neon(-1.6668057665E-1f, x, 2.0000714765E-1f)) };
+    const float32x4_t hi{ vfmaq_f32(mul_add_neon(-1.2420140846E-1f, x, 1.4249322787E-1f), x2, mul_add_neon(-1.1514610310E-1f, x, 1.1676998740E-1f)) };
+    float32x4_t res{ vmulq_f32(vfmaq_f32(lo, x4, hi), vmulq_f32(x2, x)) };
+
+    res = vfmaq_n_f32(res, e, -2.12194440E-4f);
+    res = vaddq_f32(res, vfmsq_f32(x, x2, vdupq_n_f32(0.5f)));
+
+    return vfmaq_n_f32(res, e, 0.693359375f);
+}
+
+static inline float32x4_t exp_neon(const float32x4_t x0) noexcept
+{
+    // x = n * ln2 + r with r in -ln2/2..ln2/2
+    const float32x4_t n{ vrndnq_f32(vmulq_n_f32(x0, 1.44269504f)) };
+    const float32x4_t x{ vfmsq_f32(vfmsq_f32(x0, n, vdupq_n_f32(0.693359375f)), n, vdupq_n_f32(-2.12194440e-4f)) };
+    const float32x4_t x2{ vmulq_f32(x, x) };
+    const float32x4_t x4{ vmulq_f32(x2, x2) };
+
+    // polynomial_5
+    const float32x4_t p{ vfmaq_f32(vfmaq_f32(mul_add_neon(1.0f / 6.0f, x, 1.0f / 2.0f), x4, mul_add_neon(1.0f / 5040.0f, x, 1.0f / 720.0f)), x2,
+        mul_add_neon(1.0f / 120.0f, x, 1.0f / 24.0f)) };
+    const float32x4_t z{ vfmaq_f32(x, p, x2) };
+
+    // 2^n, 0 below the normal range and inf above it
+    const int32x4_t ni{ vmaxq_s32(vminq_s32(vcvtq_s32_f32(n), vdupq_n_s32(128)), vdupq_n_s32(-127)) };
+    const float32x4_t pow2n{ vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(ni, vdupq_n_s32(127)), 23)) };
+
+    return vmulq_f32(vaddq_f32(z, vdupq_n_f32(1.0f)), pow2n);
+}
+
+// x^y for x >= 0
+static inline float32x4_t pow_neon(const float32x4_t x, const float y) noexcept
+{
+    return vbslq_f32(vcgtq_f32(x, vdupq_n_f32(0.0f)), exp_neon(vmulq_n_f32(log_neon(x), y)), vdupq_n_f32(0.0f));
+}
+
+static inline float32x4_t clamp01_neon(const float32x4_t v) noexcept
+{
+    return vmaxq_f32(vminq_f32(v, vdupq_n_f32(1.0f)), vdupq_n_f32(0.0f));
+}
+
+static inline void prefetch_neon(const float* p) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    __prefetch(p);
+#else
+    __builtin_prefetch(p);
+#endif
+}
+
+static inline void rgb2lab_neon(const float32x4_t r, const float32x4_t g, const float32x4_t b, float32x4_t& l_lab, float32x4_t& a_lab, float32x4_t& b_lab) noexcept
+{
+    float32x4_t l_lms;
+    float32x4_t m_lms;
+    float32x4_t s_lms;
+
+    apply_matrix_neon(rgb2lms, r, g, b, l_lms, m_lms, s_lms);
+
+    const float32x4_t zero{ vdupq_n_f32(0.0f) };
+    const float32x4_t c{ vdupq_n_f32(-1024.0f) };
+
+    l_lms = vbslq_f32(vcgtq_f32(l_lms, zero), log_neon(l_lms), c);
+    m_lms = vbslq_f32(vcgtq_f32(m_lms, zero), log_neon(m_lms), c);
+    s_lms = vbslq_f32(vcgtq_f32(s_lms, zero), log_neon(s_lms), c);
+
+    apply_matrix_neon(lms2lab, l_lms, m_lms, s_lms, l_lab, a_lab, b_lab);
+}
+
+static inline void lab2rgb_neon(const float32x4_t l_lab, const float32x4_t a_lab, const float32x4_t b_lab, float32x4_t& r, float32x4_t& g, float32x4_t& b) noexcept
+{
+    float32x4_t l_lms;
+    float32x4_t m_lms;
+    float32x4_t s_lms;
+
+    apply_matrix_neon(lab2lms, l_lab, a_lab, b_lab, l_lms, m_lms, s_lms);
+
+    l_lms = exp_neon(l_lms);
+    m_lms = exp_neon(m_lms);
+    s_lms = exp_neon(s_lms);
+
+    apply_matrix_neon(lms2rgb, l_lms, m_lms, s_lms, r, g, b);
+}
+
+// The row kernels process 8 pixels (two vectors) per iteration, a block of lab_block pixels holds whole iterations.
+void convert_row_neon(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    float32x4_t l1;
+    float32x4_t a1;
+    float32x4_t b1;
+    float32x4_t a_acc{ vdupq_n_f32(0.0f) };
+    float32x4_t b_acc{ vdupq_n_f32(0.0f) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const int i{ lab_offset(x, lab_step) };
+
+        for (int j{ 0 }; j < 8; j += 4)
+        {
+            rgb2lab_neon(vld1q_f32(r + x + j), vld1q_f32(g + x + j), vld1q_f32(b + x + j), l1, a1, b1);
+
+            vst1q_f32(l_lab + i + j, l1);
+            vst1q_f32(a_lab + i + j, a1);
+            vst1q_f32(b_lab + i + j, b1);
+
+            a_acc = vaddq_f32(a_acc, a1);
+            b_acc = vaddq_f32(b_acc, b1);
+        }
+    }
+
+    a_sum += vaddvq_f32(a_acc);
+    b_sum += vaddvq_f32(b_acc);
+
+    if (width_mod8 < width)
+    {
+        // the tail is shorter than a vector and never crosses a block
+        const int i{ lab_offset(width_mod8, lab_step) };
+        convert_row_c(r + width_mod8, g + width_mod8, b + width_mod8, l_lab + i, a_lab + i, b_lab + i, width - width_mod8, lab_step, a_sum, b_sum);
+    }
+}
+
+void correct_row_neon(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+    const float32x4_t avg_a{ vdupq_n_f32(avg.first) };
+    const float32x4_t avg_b{ vdupq_n_f32(avg.second) };
+
+    float32x4_t r1;
+    float32x4_t g1;
+    float32x4_t b1;
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        // subtract the average for the color channels and convert back to linear rgb
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 8)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            prefetch_neon(l_lab + pi);
+            prefetch_neon(a_lab + pi);
+            prefetch_neon(b_lab + pi);
+        }
+
+        for (int j{ 0 }; j < 8; j += 4)
+        {
+            lab2rgb_neon(vld1q_f32(l_lab + i + j), vsubq_f32(vld1q_f32(a_lab + i + j), avg_a), vsubq_f32(vld1q_f32(b_lab + i + j), avg_b), r1, g1, b1);
+
+            vst1q_f32(r + x + j, clamp01_neon(r1));
+            vst1q_f32(g + x + j, clamp01_neon(g1));
+            vst1q_f32(b + x + j, clamp01_neon(b1));
+        }
+    }
+
+    if (width_mod8 < width)
+    {
+        const int i{ lab_offset(width_mod8, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod8, g + width_mod8, b + width_mod8, avg, width - width_mod8, lab_step, 0);
+    }
+}
+
+static inline void store_u8_neon(const uint8x16_t v, float* __restrict dst, const float scale) noexcept
+{
+    const uint16x8_t lo{ vmovl_u8(vget_low_u8(v)) };
+    const uint16x8_t hi{ vmovl_high_u8(v) };
+
+    vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), scale));
+    vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(lo)), scale));
+    vst1q_f32(dst + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), scale));
+    vst1q_f32(dst + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(hi)), scale));
+}
+
+static inline void store_u16_neon(const uint16x8_t v, float* __restrict dst, const float scale) noexcept
+{
+    vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), scale));
+    vst1q_f32(dst + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_high_u16(v)), scale));
+}
+
+// The structure loads deinterleave B, G, R(, A) and read only the pixels of the row.
+void unpack_rgb24_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const uint8x16x3_t px{ vld3q_u8(src + x * 3) };
+
+        store_u8_neon(px.val[0], b + x, 1.0f / 255.0f);
+        store_u8_neon(px.val[1], g + x, 1.0f / 255.0f);
+        store_u8_neon(px.val[2], r + x, 1.0f / 255.0f);
+    }
+
+    unpack_rgb24_row_c(src + width_mod16 * 3, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+void unpack_rgb32_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod16{ width - (width % 16) };
+
+    for (int x{ 0 }; x < width_mod16; x += 16)
+    {
+        const uint8x16x4_t px{ vld4q_u8(src + x * 4) };
+
+        store_u8_neon(px.val[0], b + x, 1.0f / 255.0f);
+        store_u8_neon(px.val[1], g + x, 1.0f / 255.0f);
+        store_u8_neon(px.val[2], r + x, 1.0f / 255.0f);
+    }
+
+    unpack_rgb32_row_c(src + width_mod16 * 4, r + width_mod16, g + width_mod16, b + width_mod16, width - width_mod16);
+}
+
+void unpack_rgb48_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const uint16_t* s{ reinterpret_cast<const uint16_t*>(src) };
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const uint16x8x3_t px{ vld3q_u16(s + x * 3) };
+
+        store_u16_neon(px.val[0], b + x, 1.0f / 65535.0f);
+        store_u16_neon(px.val[1], g + x, 1.0f / 65535.0f);
+        store_u16_neon(px.val[2], r + x, 1.0f / 65535.0f);
+    }
+
+    unpack_rgb48_row_c(src + width_mod8 * 6, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+void unpack_rgb64_row_neon(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const uint16_t* s{ reinterpret_cast<const uint16_t*>(src) };
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const uint16x8x4_t px{ vld4q_u16(s + x * 4) };
+
+        store_u16_neon(px.val[0], b + x, 1.0f / 65535.0f);
+        store_u16_neon(px.val[1], g + x, 1.0f / 65535.0f);
+        store_u16_neon(px.val[2], r + x, 1.0f / 65535.0f);
+    }
+
+    unpack_rgb64_row_c(src + width_mod8 * 8, r + width_mod8, g + width_mod8, b + width_mod8, width - width_mod8);
+}
+
+static inline float32x4_t to_linear_neon(const float32x4_t v0, const grayworld_transfer transfer) noexcept
+{
+    const float32x4_t v{ clamp01_neon(v0) };
+
+    if (transfer == grayworld_transfer::bt709)
+        return vbslq_f32(vcltq_f32(v, vdupq_n_f32(0.081f)), vmulq_n_f32(v, 1.0f / 4.5f), pow_neon(vmulq_n_f32(vaddq_f32(v, vdupq_n_f32(0.099f)), 1.0f / 1.099f), 1.0f / 0.45f));
+
+    const float32x4_t p{ pow_neon(v, 1.0f / pq_m2) };
+    return pow_neon(vdivq_f32(vmaxq_f32(vsubq_f32(p, vdupq_n_f32(pq_c1)), vdupq_n_f32(0.0f)), vfmsq_f32(vdupq_n_f32(pq_c2), p, vdupq_n_f32(pq_c3))), 1.0f / pq_m1);
+}
+
+static inline float32x4_t from_linear_neon(const float32x4_t l, const grayworld_transfer transfer) noexcept
+{
+    if (transfer == grayworld_transfer::bt709)
+        return vbslq_f32(vcltq_f32(l, vdupq_n_f32(0.018f)), vmulq_n_f32(l, 4.5f), vsubq_f32(vmulq_n_f32(pow_neon(l, 0.45f), 1.099f), vdupq_n_f32(0.099f)));
+
+    const float32x4_t p{ pow_neon(l, pq_m1) };
+    return pow_neon(vdivq_f32(mul_add_neon(pq_c2, p, pq_c1), mul_add_neon(pq_c3, p, 1.0f)), pq_m2);
+}
+
+void yuv_to_rgb_row_neon(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const float cr{ 2.0f * (1.0f - yuv.kr) };
+    const float cb{ 2.0f * (1.0f - yuv.kb) };
+    const float kg_rcp{ 1.0f / (1.0f - yuv.kr - yuv.kb) };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const float32x4_t y1{ vld1q_f32(y + x) };
+        const float32x4_t rp{ vfmaq_n_f32(y1, vld1q_f32(v + x), cr) };
+        const float32x4_t bp{ vfmaq_n_f32(y1, vld1q_f32(u + x), cb) };
+        const float32x4_t gp{ vmulq_n_f32(vfmsq_f32(vfmsq_f32(y1, rp, vdupq_n_f32(yuv.kr)), bp, vdupq_n_f32(yuv.kb)), kg_rcp) };
+
+        vst1q_f32(r + x, to_linear_neon(rp, yuv.transfer));
+        vst1q_f32(g + x, to_linear_neon(gp, yuv.transfer));
+        vst1q_f32(b + x, to_linear_neon(bp, yuv.transfer));
+    }
+
+    if (width_mod4 < width)
+        yuv_to_rgb_row_c(y + width_mod4, u + width_mod4, v + width_mod4, r + width_mod4, g + width_mod4, b + width_mod4, yuv, width - width_mod4);
+}
+
+void rgb_to_yuv_row_neon(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const float kg{ 1.0f - yuv.kr - yuv.kb };
+    const float cb_rcp{ 1.0f / (2.0f * (1.0f - yuv.kb)) };
+    const float cr_rcp{ 1.0f / (2.0f * (1.0f - yuv.kr)) };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const float32x4_t rp{ from_linear_neon(vld1q_f32(r + x), yuv.transfer) };
+        const float32x4_t gp{ from_linear_neon(vld1q_f32(g + x), yuv.transfer) };
+        const float32x4_t bp{ from_linear_neon(vld1q_f32(b + x), yuv.transfer) };
+        const float32x4_t y1{ vfmaq_n_f32(vfmaq_n_f32(vmulq_n_f32(rp, yuv.kr), gp, kg), bp, yuv.kb) };
+
+        vst1q_f32(y + x, y1);
+        vst1q_f32(u + x, vmulq_n_f32(vsubq_f32(bp, y1), cb_rcp));
+        vst1q_f32(v + x, vmulq_n_f32(vsubq_f32(rp, y1), cr_rcp));
+    }
+
+    if (width_mod4 < width)
+        rgb_to_yuv_row_c(r + width_mod4, g + width_mod4, b + width_mod4, y + width_mod4, u + width_mod4, v + width_mod4, yuv, width - width_mod4);
+}
+
+// The half precision conversions are part of the base AArch64 instruction set.
+void float_to_half_row_neon(const float* src, uint16_t* __restrict dst, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+        vst1q_u16(dst + x, vreinterpretq_u16_f16(vcvt_high_f16_f32(vcvt_f16_f32(vld1q_f32(src + x)), vld1q_f32(src + x + 4))));
+
+    if (width_mod8 < width)
+        float_to_half_row_c(src + width_mod8, dst + width_mod8, width - width_mod8);
+}
+
+void half_to_float_row_neon(const uint16_t* src, float* __restrict dst, const int width) noexcept
+{
+    const int width_mod8{ width - (width % 8) };
+
+    for (int x{ 0 }; x < width_mod8; x += 8)
+    {
+        const float16x8_t h{ vreinterpretq_f16_u16(vld1q_u16(src + x)) };
+
+        vst1q_f32(dst + x, vcvt_f32_f16(vget_low_f16(h)));
+        vst1q_f32(dst + x + 4, vcvt_high_f32_f16(h));
+    }
+
+    if (width_mod8 < width)
+        half_to_float_row_c(src + width_mod8, dst + width_mod8, width - width_mod8);
+}
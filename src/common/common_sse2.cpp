@@ -39,3 +39,314 @@ void lab2rgb_sse2(const Vec4f l_lab, const Vec4f a_lab, const Vec4f b_lab, Vec4f
 
     apply_matrix_sse2(lms2rgb, l_lms, m_lms, s_lms, r, g, b);
 }
+
+void convert_row_sse2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+
+    Vec4f l1;
+    Vec4f a1;
+    Vec4f b1;
+    Vec4f a_acc{ zero_4f() };
+    Vec4f b_acc{ zero_4f() };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        rgb2lab_sse2(Vec4f().load(r + x), Vec4f().load(g + x), Vec4f().load(b + x), l1, a1, b1);
+
+        const int i{ lab_offset(x, lab_step) };
+        l1.store(l_lab + i);
+        a1.store(a_lab + i);
+        b1.store(b_lab + i);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod4 < width)
+    {
+        // the tail is shorter than a vector and never crosses a block
+        const int i{ lab_offset(width_mod4, lab_step) };
+        convert_row_c(r + width_mod4, g + width_mod4, b + width_mod4, l_lab + i, a_lab + i, b_lab + i, width - width_mod4, lab_step, a_sum, b_sum);
+    }
+}
+
+void correct_row_sse2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const Vec4f avg_a{ avg.first };
+    const Vec4f avg_b{ avg.second };
+
+    Vec4f r1;
+    Vec4f g1;
+    Vec4f b1;
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        // subtract the average for the color channels and convert back to linear rgb
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 4)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_sse2(Vec4f().load(l_lab + i), Vec4f().load(a_lab + i) - avg_a, Vec4f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec4f(1.0f)), Vec4f(0.0f)).store(r + x);
+        max(min(g1, Vec4f(1.0f)), Vec4f(0.0f)).store(g + x);
+        max(min(b1, Vec4f(1.0f)), Vec4f(0.0f)).store(b + x);
+    }
+
+    if (width_mod4 < width)
+    {
+        const int i{ lab_offset(width_mod4, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod4, g + width_mod4, b + width_mod4, avg, width - width_mod4, lab_step, 0);
+    }
+}
+
+void convert_row_stream_sse2(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept
+{
+    const int head{ (lab_step == lab_block) ? stream_head<16>(l_lab, a_lab, b_lab, width) : -1 };
+    if (head < 0)
+    {
+        convert_row_sse2(r, g, b, l_lab, a_lab, b_lab, width, lab_step, a_sum, b_sum);
+        return;
+    }
+
+    convert_row_c(r, g, b, l_lab, a_lab, b_lab, head, lab_step, a_sum, b_sum);
+
+    const int width_mod4{ head + ((width - head) & ~3) };
+
+    Vec4f l1;
+    Vec4f a1;
+    Vec4f b1;
+    Vec4f a_acc{ zero_4f() };
+    Vec4f b_acc{ zero_4f() };
+
+    for (int x{ head }; x < width_mod4; x += 4)
+    {
+        rgb2lab_sse2(Vec4f().load(r + x), Vec4f().load(g + x), Vec4f().load(b + x), l1, a1, b1);
+
+        l1.store_nt(l_lab + x);
+        a1.store_nt(a_lab + x);
+        b1.store_nt(b_lab + x);
+
+        a_acc += a1;
+        b_acc += b1;
+    }
+
+    a_sum += horizontal_add(a_acc);
+    b_sum += horizontal_add(b_acc);
+
+    if (width_mod4 < width)
+        convert_row_c(r + width_mod4, g + width_mod4, b + width_mod4, l_lab + width_mod4, a_lab + width_mod4, b_lab + width_mod4, width - width_mod4, lab_step, a_sum, b_sum);
+
+    _mm_sfence();
+}
+
+void correct_row_stream_sse2(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept
+{
+    // a head would shift the vectors across the blocks of the interleaved layout
+    const int head{ stream_head<16>(r, g, b, width) };
+    if (head < 0 || (head > 0 && lab_step != lab_block))
+    {
+        correct_row_sse2(l_lab, a_lab, b_lab, r, g, b, avg, width, lab_step, prefetch);
+        return;
+    }
+
+    correct_row_c(l_lab, a_lab, b_lab, r, g, b, avg, head, lab_step, 0);
+
+    const int width_mod4{ head + ((width - head) & ~3) };
+    const Vec4f avg_a{ avg.first };
+    const Vec4f avg_b{ avg.second };
+
+    Vec4f r1;
+    Vec4f g1;
+    Vec4f b1;
+
+    for (int x{ head }; x < width_mod4; x += 4)
+    {
+        const int i{ lab_offset(x, lab_step) };
+
+        // once per block of lab_block pixels
+        if (prefetch && (x % lab_block) < 4)
+        {
+            const int pi{ lab_offset(x + prefetch, lab_step) };
+            _mm_prefetch(reinterpret_cast<const char*>(l_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(a_lab + pi), _MM_HINT_T0);
+            _mm_prefetch(reinterpret_cast<const char*>(b_lab + pi), _MM_HINT_T0);
+        }
+
+        lab2rgb_sse2(Vec4f().load(l_lab + i), Vec4f().load(a_lab + i) - avg_a, Vec4f().load(b_lab + i) - avg_b, r1, g1, b1);
+
+        max(min(r1, Vec4f(1.0f)), Vec4f(0.0f)).store_nt(r + x);
+        max(min(g1, Vec4f(1.0f)), Vec4f(0.0f)).store_nt(g + x);
+        max(min(b1, Vec4f(1.0f)), Vec4f(0.0f)).store_nt(b + x);
+    }
+
+    if (width_mod4 < width)
+    {
+        const int i{ lab_offset(width_mod4, lab_step) };
+        correct_row_c(l_lab + i, a_lab + i, b_lab + i, r + width_mod4, g + width_mod4, b + width_mod4, avg, width - width_mod4, lab_step, 0);
+    }
+
+    _mm_sfence();
+}
+
+void unpack_rgb24_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each load reads 16 bytes but uses 12, keep the last load inside the row
+    const int width_mod4{ std::max(width - 2, 0) & ~3 };
+    const Vec4f scale{ 1.0f / 255.0f };
+    const Vec4ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4ui px{ Vec4ui(permute16<0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1>(Vec16uc().load(src + x * 3))) };
+
+        (to_float(Vec4i(px & mask)) * scale).store(b + x);
+        (to_float(Vec4i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec4i(px >> 16)) * scale).store(r + x);
+    }
+
+    unpack_rgb24_row_c(src + width_mod4 * 3, r + width_mod4, g + width_mod4, b + width_mod4, width - width_mod4);
+}
+
+void unpack_rgb32_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const Vec4f scale{ 1.0f / 255.0f };
+    const Vec4ui mask{ 0xFF };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4ui px{ Vec4ui().load(src + x * 4) };
+
+        (to_float(Vec4i(px & mask)) * scale).store(b + x);
+        (to_float(Vec4i((px >> 8) & mask)) * scale).store(g + x);
+        (to_float(Vec4i((px >> 16) & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb32_row_c(src + width_mod4 * 4, r + width_mod4, g + width_mod4, b + width_mod4, width - width_mod4);
+}
+
+void unpack_rgb48_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    // each half of the pixels is loaded with 16 bytes but uses 12, keep the last load inside the row
+    const int width_mod4{ std::max(width - 1, 0) & ~3 };
+    const Vec4f scale{ 1.0f / 65535.0f };
+    const Vec4ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4ui p0{ Vec4ui(permute8<0, 1, 2, -1, 3, 4, 5, -1>(Vec8us().load(src + x * 6))) };
+        const Vec4ui p1{ Vec4ui(permute8<0, 1, 2, -1, 3, 4, 5, -1>(Vec8us().load(src + x * 6 + 12))) };
+        const Vec4ui lo{ blend4<0, 2, 4, 6>(p0, p1) };
+        const Vec4ui hi{ blend4<1, 3, 5, 7>(p0, p1) };
+
+        (to_float(Vec4i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec4i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec4i(hi)) * scale).store(r + x);
+    }
+
+    unpack_rgb48_row_c(src + width_mod4 * 6, r + width_mod4, g + width_mod4, b + width_mod4, width - width_mod4);
+}
+
+void unpack_rgb64_row_sse2(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const Vec4f scale{ 1.0f / 65535.0f };
+    const Vec4ui mask{ 0xFFFF };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4ui p0{ Vec4ui().load(src + x * 8) };
+        const Vec4ui p1{ Vec4ui().load(src + x * 8 + 16) };
+        const Vec4ui lo{ blend4<0, 2, 4, 6>(p0, p1) };
+        const Vec4ui hi{ blend4<1, 3, 5, 7>(p0, p1) };
+
+        (to_float(Vec4i(lo & mask)) * scale).store(b + x);
+        (to_float(Vec4i(lo >> 16)) * scale).store(g + x);
+        (to_float(Vec4i(hi & mask)) * scale).store(r + x);
+    }
+
+    unpack_rgb64_row_c(src + width_mod4 * 8, r + width_mod4, g + width_mod4, b + width_mod4, width - width_mod4);
+}
+
+static inline Vec4f to_linear_sse2(const Vec4f v0, const grayworld_transfer transfer) noexcept
+{
+    const Vec4f v{ max(min(v0, Vec4f(1.0f)), Vec4f(0.0f)) };
+
+    if (transfer == grayworld_transfer::bt709)
+        return select(v < Vec4f(0.081f), v * (1.0f / 4.5f), pow((v + 0.099f) * (1.0f / 1.099f), 1.0f / 0.45f));
+
+    const Vec4f p{ pow(v, 1.0f / pq_m2) };
+    return pow(max(p - pq_c1, Vec4f(0.0f)) / (Vec4f(pq_c2) - pq_c3 * p), 1.0f / pq_m1);
+}
+
+static inline Vec4f from_linear_sse2(const Vec4f l, const grayworld_transfer transfer) noexcept
+{
+    if (transfer == grayworld_transfer::bt709)
+        return select(l < Vec4f(0.018f), l * 4.5f, 1.099f * pow(l, 0.45f) - 0.099f);
+
+    const Vec4f p{ pow(l, pq_m1) };
+    return pow((pq_c1 + pq_c2 * p) / (1.0f + pq_c3 * p), pq_m2);
+}
+
+void yuv_to_rgb_row_sse2(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const Vec4f cr{ 2.0f * (1.0f - yuv.kr) };
+    const Vec4f cb{ 2.0f * (1.0f - yuv.kb) };
+    const Vec4f kr{ yuv.kr };
+    const Vec4f kb{ yuv.kb };
+    const Vec4f kg_rcp{ 1.0f / (1.0f - yuv.kr - yuv.kb) };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4f y1{ Vec4f().load(y + x) };
+        const Vec4f rp{ mul_add(cr, Vec4f().load(v + x), y1) };
+        const Vec4f bp{ mul_add(cb, Vec4f().load(u + x), y1) };
+        const Vec4f gp{ (y1 - kr * rp - kb * bp) * kg_rcp };
+
+        to_linear_sse2(rp, yuv.transfer).store(r + x);
+        to_linear_sse2(gp, yuv.transfer).store(g + x);
+        to_linear_sse2(bp, yuv.transfer).store(b + x);
+    }
+
+    if (width_mod4 < width)
+        yuv_to_rgb_row_c(y + width_mod4, u + width_mod4, v + width_mod4, r + width_mod4, g + width_mod4, b + width_mod4, yuv, width - width_mod4);
+}
+
+void rgb_to_yuv_row_sse2(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept
+{
+    const int width_mod4{ width - (width % 4) };
+    const Vec4f kr{ yuv.kr };
+    const Vec4f kb{ yuv.kb };
+    const Vec4f kg{ 1.0f - yuv.kr - yuv.kb };
+    const Vec4f cb_rcp{ 1.0f / (2.0f * (1.0f - yuv.kb)) };
+    const Vec4f cr_rcp{ 1.0f / (2.0f * (1.0f - yuv.kr)) };
+
+    for (int x{ 0 }; x < width_mod4; x += 4)
+    {
+        const Vec4f rp{ from_linear_sse2(Vec4f().load(r + x), yuv.transfer) };
+        const Vec4f gp{ from_linear_sse2(Vec4f().load(g + x), yuv.transfer) };
+        const Vec4f bp{ from_linear_sse2(Vec4f().load(b + x), yuv.transfer) };
+        const Vec4f y1{ kr * rp + kg * gp + kb * bp };
+
+        y1.store(y + x);
+        ((bp - y1) * cb_rcp).store(u + x);
+        ((rp - y1) * cr_rcp).store(v + x);
+    }
+
+    if (width_mod4 < width)
+        rgb_to_yuv_row_c(r + width_mod4, g + width_mod4, b + width_mod4, y + width_mod4, u + width_mod4, v + width_mod4, yuv, width - width_mod4);
+}
@@ -0,0 +1,255 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+#include "grayworld_core.h"
+#if !defined(GRAYWORLD_ARM64)
+#include "../VCL2/instrset.h"
+#endif
+
+// The kernels of every tier, indexed by opt.
+struct grayworld_isa
+{
+    decltype(grayworld_kernels::convert_row) convert_row;
+    decltype(grayworld_kernels::correct_row) correct_row;
+    decltype(grayworld_kernels::convert_row) convert_row_stream;
+    decltype(grayworld_kernels::correct_row) correct_row_stream;
+    // rgb24, rgb32, rgb48, rgb64
+    decltype(grayworld_kernels::unpack_row) unpack_row[4];
+    decltype(grayworld_kernels::yuv_to_rgb_row) yuv_to_rgb_row;
+    decltype(grayworld_kernels::rgb_to_yuv_row) rgb_to_yuv_row;
+    decltype(grayworld_kernels::float_to_half_row) float_to_half_row;
+    decltype(grayworld_kernels::half_to_float_row) half_to_float_row;
+    const char* name;
+    // default prefetch distance in pixels (from a 4K/8K sweep of 0..1024)
+    int prefetch;
+};
+
+static constexpr grayworld_isa isa_table[]{
+    {
+        convert_row_c, correct_row_c, convert_row_c, correct_row_c,
+        { unpack_rgb24_row_c, unpack_rgb32_row_c, unpack_rgb48_row_c, unpack_rgb64_row_c },
+        yuv_to_rgb_row_c, rgb_to_yuv_row_c, float_to_half_row_c, half_to_float_row_c, "C", 0
+    },
+#if defined(GRAYWORLD_ARM64)
+    // opt=1, the hardware prefetchers already follow the three LAB streams
+    {
+        convert_row_neon, correct_row_neon, convert_row_neon, correct_row_neon,
+        { unpack_rgb24_row_neon, unpack_rgb32_row_neon, unpack_rgb48_row_neon, unpack_rgb64_row_neon },
+        yuv_to_rgb_row_neon, rgb_to_yuv_row_neon, float_to_half_row_neon, half_to_float_row_neon, "NEON", 0
+    }
+#else
+    {
+        convert_row_sse2, correct_row_sse2, convert_row_stream_sse2, correct_row_stream_sse2,
+        { unpack_rgb24_row_sse2, unpack_rgb32_row_sse2, unpack_rgb48_row_sse2, unpack_rgb64_row_sse2 },
+        yuv_to_rgb_row_sse2, rgb_to_yuv_row_sse2, float_to_half_row_c, half_to_float_row_c, "SSE2", 64
+    },
+    {
+        convert_row_avx2, correct_row_avx2, convert_row_stream_avx2, correct_row_stream_avx2,
+        { unpack_rgb24_row_avx2, unpack_rgb32_row_avx2, unpack_rgb48_row_avx2, unpack_rgb64_row_avx2 },
+        yuv_to_rgb_row_avx2, rgb_to_yuv_row_avx2, float_to_half_row_avx2, half_to_float_row_avx2, "AVX2", 512
+    },
+    {
+        convert_row_avx512, correct_row_avx512, convert_row_stream_avx512, correct_row_stream_avx512,
+        { unpack_rgb24_row_avx512, unpack_rgb32_row_avx512, unpack_rgb48_row_avx512, unpack_rgb64_row_avx512 },
+        yuv_to_rgb_row_avx512, rgb_to_yuv_row_avx512, float_to_half_row_avx512, half_to_float_row_avx512, "AVX512", 512
+    },
+    {
+        convert_row_avx512fp16, correct_row_avx512fp16, convert_row_stream_avx512fp16, correct_row_stream_avx512fp16,
+        { unpack_rgb24_row_avx512, unpack_rgb32_row_avx512, unpack_rgb48_row_avx512, unpack_rgb64_row_avx512 },
+        yuv_to_rgb_row_avx512, rgb_to_yuv_row_avx512, float_to_half_row_avx512, half_to_float_row_avx512, "AVX512FP16", 512
+    }
+#endif
+};
+
+static constexpr int isa_count{ static_cast<int>(std::size(isa_table)) };
+
+const grayworld_cpu& grayworld_cpu_features() noexcept
+{
+    static const grayworld_cpu cpu{ []() noexcept
+    {
+        grayworld_cpu c{};
+#if defined(GRAYWORLD_ARM64)
+        // Advanced SIMD is part of the base AArch64 instruction set
+        c.neon = true;
+#else
+        const int iset{ instrset_detect() };
+
+        c.sse2 = iset >= 2;
+        c.avx2 = iset >= 8;
+        c.f16c = hasF16C();
+        c.avx512 = iset >= 10;
+        c.avx512fp16 = hasAVX512FP16();
+#endif
+
+        return c;
+    }() };
+
+    return cpu;
+}
+
+bool grayworld_supports(const grayworld_cpu& cpu, const int opt, const bool fp16) noexcept
+{
+    switch (opt)
+    {
+        case 4: return cpu.avx512fp16;
+        case 3: return cpu.avx512;
+        // the fp16 scratch conversion of the AVX2 code requires F16C
+        case 2: return cpu.avx2 && (!fp16 || cpu.f16c);
+        case 1: return cpu.sse2 || cpu.neon;
+        default: return true;
+    }
+}
+
+int grayworld_dispatch(int opt, const grayworld_cpu& cpu, const bool fp16) noexcept
+{
+    bool forced{ false };
+
+    if (const char* v{ std::getenv("GRAYWORLD_OPT") }; v && *v)
+    {
+        char* end;
+        const long env_opt{ std::strtol(v, &end, 10) };
+
+        if (*end == '\0' && env_opt >= -1 && env_opt <= 4)
+        {
+            opt = static_cast<int>(env_opt);
+            forced = true;
+        }
+    }
+
+    if (opt < 0)
+    {
+        // the half precision log/exp is only selected automatically when the LAB values are rounded to fp16 anyway
+        opt = (cpu.avx512fp16 && fp16) ? 4 : 3;
+
+        while (opt > 0 && !grayworld_supports(cpu, opt, fp16))
+            --opt;
+    }
+    else if (forced)
+    {
+        // a farm wide override must not crash the older hosts
+        while (opt > 0 && !grayworld_supports(cpu, opt, fp16))
+            --opt;
+    }
+
+    static std::atomic_flag logged = ATOMIC_FLAG_INIT;
+    if (!logged.test_and_set())
+        std::fprintf(stderr, "grayworld: using %s code%s\n", isa_table[std::min(opt, isa_count - 1)].name, (forced) ? " (GRAYWORLD_OPT)" : "");
+
+    return opt;
+}
+
+grayworld_kernels get_kernels(const int opt, const grayworld_mode mode, const grayworld_input input, const grayworld_layout layout, const grayworld_precision precision,
+    const bool stream, const int prefetch) noexcept
+{
+    const grayworld_isa& isa{ isa_table[std::clamp(opt, 0, isa_count - 1)] };
+
+    grayworld_kernels k{};
+    k.layout = layout;
+    k.precision = precision;
+
+    k.compute = (mode == grayworld_mode::mean) ? compute_correction<grayworld_mode::mean> : compute_correction<grayworld_mode::median>;
+
+    k.convert_row = isa.convert_row;
+    k.correct_row = isa.correct_row;
+    k.convert_row_frame = (stream) ? isa.convert_row_stream : isa.convert_row;
+    k.correct_row_frame = (stream) ? isa.correct_row_stream : isa.correct_row;
+    k.yuv_to_rgb_row = isa.yuv_to_rgb_row;
+    k.rgb_to_yuv_row = isa.rgb_to_yuv_row;
+    k.float_to_half_row = isa.float_to_half_row;
+    k.half_to_float_row = isa.half_to_float_row;
+    k.isa = isa.name;
+
+    switch (input)
+    {
+        case grayworld_input::rgb24: k.unpack_row = isa.unpack_row[0]; break;
+        case grayworld_input::rgb32: k.unpack_row = isa.unpack_row[1]; break;
+        case grayworld_input::rgb48: k.unpack_row = isa.unpack_row[2]; break;
+        case grayworld_input::rgb64: k.unpack_row = isa.unpack_row[3]; break;
+        default: break;
+    }
+
+    k.prefetch = (prefetch >= 0) ? prefetch : isa.prefetch;
+    k.bands = 1;
+
+    return k;
+}
+
+int lab_row_size(const int width, const grayworld_layout layout) noexcept
+{
+    return 3 * ((layout == grayworld_layout::planar) ? width : (width + lab_block - 1) / lab_block * lab_block);
+}
+
+size_t lab_scratch_size(const grayworld_kernels& k, const int width, const int rows) noexcept
+{
+    const size_t n{ static_cast<size_t>(lab_row_size(width, k.layout)) * rows };
+
+    return (k.precision == grayworld_precision::fp32) ? n : (n + 1) / 2;
+}
+
+// A part of the row buffers, rounded up to 64 bytes.
+static size_t row_part(const size_t n) noexcept
+{
+    return (n + 15) & ~size_t{ 15 };
+}
+
+size_t row_scratch_size(const grayworld_kernels& k, const grayworld_input input, const int width) noexcept
+{
+    const size_t w{ static_cast<size_t>(width) };
+    // the fp16 scratch row, then convert_rows: the rgb, median a/b and yuv rows, or correct_rows: the yuv rows (see grayworld_frame.cpp)
+    const size_t lab{ (k.precision == grayworld_precision::fp16) ? row_part(lab_row_size(width, k.layout)) : 0 };
+    const size_t convert{ ((input != grayworld_input::planar) ? row_part(3 * w) : 0) + row_part(2 * w) + ((input == grayworld_input::yuv) ? row_part(5 * w) : 0) };
+    const size_t correct{ (input == grayworld_input::yuv) ? row_part(9 * w) : 0 };
+
+    return lab + std::max(convert, correct);
+}
+
+int tile_height(const int width, const int tile) noexcept
+{
+    if (tile > 0)
+        return (std::min(tile, 1 << 20) + 1) & ~1;
+
+    size_t l2{ 0 };
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    const long size{ sysconf(_SC_LEVEL2_CACHE_SIZE) };
+    if (size > 0)
+        l2 = static_cast<size_t>(size);
+#endif
+    if (l2 == 0)
+        l2 = 1024 * 1024;
+
+    // half of L2 for the LAB strip, the rest for the source and destination rows that stream through
+    const size_t rows{ l2 / 2 / (sizeof(float) * 3 * std::max(width, 1)) };
+
+    return std::max(static_cast<int>(std::min<size_t>(rows, 1 << 20)), 2) & ~1;
+}
+
+bool grayworld_frame_yuv(grayworld_yuv& yuv, const int64_t chroma_location, const int64_t color_range) noexcept
+{
+    if (chroma_location > 5 || color_range > 1)
+        return false;
+
+    if (chroma_location >= 0)
+    {
+        // the bottom sitings are the top sitings without vertical subsampling
+        if (chroma_location > 3 && yuv.ss_h)
+            return false;
+
+        yuv.chroma_location = (chroma_location > 3) ? static_cast<int>(chroma_location) - 4 : static_cast<int>(chroma_location);
+    }
+
+    if (color_range >= 0)
+        yuv.full_range = color_range == 0;
+
+    return true;
+}
+
+int frame_strip_height(const int width, const int height, const int tile) noexcept
+{
+    return (tile != 0) ? std::min(tile_height(width, tile), height + (height & 1)) : 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "common.h"
+
+enum class grayworld_input
+{
+    planar,
+    rgb24,
+    rgb32,
+    rgb48,
+    rgb64,
+    yuv
+};
+
+// Layout of the LAB scratch.
+// planar: the L, a and b planes follow each other.
+// interleaved: every row is stored as blocks of lab_block pixels [L x lab_block | a x lab_block | b x lab_block].
+enum class grayworld_layout
+{
+    planar,
+    interleaved
+};
+
+// Precision of the LAB scratch. fp16 halves the scratch size, the values are converted per row.
+enum class grayworld_precision
+{
+    fp32,
+    fp16
+};
+
+struct grayworld_kernels
+{
+    void (*convert_row)(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+    void (*correct_row)(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+    // used for the rows that are written to the frame scratch and to the output planes, non-temporal when streaming is enabled
+    void (*convert_row_frame)(const float* r, const float* g, const float* b, float* __restrict l_lab, float* __restrict a_lab, float* __restrict b_lab, const int width, const int lab_step, float& a_sum, float& b_sum) noexcept;
+    void (*correct_row_frame)(const float* l_lab, const float* a_lab, const float* b_lab, float* __restrict r, float* __restrict g, float* __restrict b, const std::pair<float, float>& avg, const int width, const int lab_step, const int prefetch) noexcept;
+    void (*unpack_row)(const uint8_t* src, float* __restrict r, float* __restrict g, float* __restrict b, const int width) noexcept;
+    void (*yuv_to_rgb_row)(const float* y, const float* u, const float* v, float* __restrict r, float* __restrict g, float* __restrict b, const grayworld_yuv& yuv, const int width) noexcept;
+    void (*rgb_to_yuv_row)(const float* r, const float* g, const float* b, float* __restrict y, float* __restrict u, float* __restrict v, const grayworld_yuv& yuv, const int width) noexcept;
+    void (*float_to_half_row)(const float* src, uint16_t* __restrict dst, const int width) noexcept;
+    void (*half_to_float_row)(const uint16_t* src, float* __restrict dst, const int width) noexcept;
+    std::pair<float, float>(*compute)(float* line_sum, int* line_count_pels, const int height) noexcept;
+    const char* isa;
+    grayworld_layout layout;
+    grayworld_precision precision;
+    // prefetch distance of the correct pass in pixels
+    int prefetch;
+    // the number of row bands of a frame that run in parallel on the shared thread_pool (1: only the calling thread).
+    // The strip modes use one strip of the scratch per band.
+    int bands;
+};
+
+// The CPU features that the tiers need.
+struct grayworld_cpu
+{
+    bool sse2;
+    bool avx2;
+    bool f16c;
+    bool avx512;
+    bool avx512fp16;
+    bool neon;
+};
+
+// The features of this CPU, detected once. AVX10 CPUs also report AVX512FP16.
+const grayworld_cpu& grayworld_cpu_features() noexcept;
+// Whether cpu can run opt (see get_kernels), fp16 is the fp16 LAB scratch.
+bool grayworld_supports(const grayworld_cpu& cpu, const int opt, const bool fp16) noexcept;
+// Returns the opt to pass to get_kernels. opt -1 selects the fastest tier of cpu, opt=4 only with the fp16 scratch.
+// The GRAYWORLD_OPT environment variable (-1..4) overrides opt, a tier that cpu doesn't support is lowered to a supported one.
+// The chosen tier is printed to stderr once per process.
+int grayworld_dispatch(int opt, const grayworld_cpu& cpu, const bool fp16) noexcept;
+
+// opt: 0 - C, 1 - SSE2, 2 - AVX2 (fp16 requires F16C), 3 - AVX512, 4 - AVX512FP16 (AVX512 with half precision log/exp).
+// On AArch64 opt=1 is NEON and opt 2..4 don't exist.
+// stream: use non-temporal stores for the planar float output and the fp32 planar scratch (SIMD only).
+// prefetch: the prefetch distance of the correct pass in pixels, 0 - disabled, -1 - the default of the ISA.
+grayworld_kernels get_kernels(const int opt, const grayworld_mode mode, const grayworld_input input, const grayworld_layout layout, const grayworld_precision precision,
+    const bool stream, const int prefetch) noexcept;
+// The number of LAB values of the scratch that one row uses.
+int lab_row_size(const int width, const grayworld_layout layout) noexcept;
+// The number of floats to allocate for a LAB scratch of rows rows.
+size_t lab_scratch_size(const grayworld_kernels& k, const int width, const int rows) noexcept;
+// The number of floats of the row buffers of one band for both modes (the rows argument of the frame functions holds k.bands of them).
+size_t row_scratch_size(const grayworld_kernels& k, const grayworld_input input, const int width) noexcept;
+
+// Applies the _ChromaLocation (0..5) and _ColorRange (0 - full, 1 - limited) frame properties of a YUV frame to yuv, -1: the property isn't set.
+// Returns false for the bottom sitings (4, 5) of vertically subsampled chroma and for unknown values.
+bool grayworld_frame_yuv(grayworld_yuv& yuv, const int64_t chroma_location, const int64_t color_range) noexcept;
+
+// srcp holds the R, G, B (or Y, U, V) planes for planar input or the first row of the packed frame in srcp[0].
+// Pitches are in bytes and may be negative (bottom-up packed frames). yuv is only used for grayworld_input::yuv.
+// rows: k.bands * row_scratch_size() floats aligned to 64 bytes, the row buffers of the bands.
+void convert_frame(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict tmpplab, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept;
+// For grayworld_input::yuv the output planes are Y, U, V in the same format as the source, otherwise planar float R, G, B.
+void correct_frame(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const float* tmpplab,
+    float* rows, const std::pair<float, float>& avg, const int width, const int height) noexcept;
+
+// Tiled mode. The frame is processed in strips of strip_height rows that use a strip_height * lab_row_size() LAB scratch (k.bands strips).
+// The first pass only gathers the row statistics, the second pass converts every strip again and corrects it while it is cache resident.
+// tile > 0 sets the strip height, otherwise it is derived from the L2 cache size.
+int tile_height(const int width, const int tile) noexcept;
+// The strip height of a width x height frame for tile (see tile_height), 0 for tile=0 (the full frame).
+int frame_strip_height(const int width, const int height, const int tile) noexcept;
+void convert_frame_tiled(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept;
+void correct_frame_tiled(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg, float* line_sum,
+    int* line_count_pels, const int width, const int height) noexcept;
+
+// One pass mode (latency=1). Corrects the frame with avg, the offsets of the previous frame, and gathers the statistics of this frame
+// (for kernels.compute) in the same pass over the strips. The strip is used as in the tiled mode, there is no full frame LAB copy.
+void correct_frame_onepass(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg,
+    float* line_sum, int* line_count_pels, const int width, const int height) noexcept;
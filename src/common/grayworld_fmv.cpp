@@ -0,0 +1,110 @@
+#include "grayworld_core.h"
+
+// Multiversioned build (BUILD_FMV). grayworld_frame.cpp is compiled once per x86-64 level,
+// the copy of the CPU is selected once when the plugin is loaded.
+
+#define GRAYWORLD_FMV_DECLARE(level) \
+namespace level \
+{ \
+    template <grayworld_mode mode> \
+    std::pair<float, float> compute_correction(float* line_sum, int* line_count_pels, const int height) noexcept; \
+    void convert_frame(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict tmpplab, float* rows, \
+        const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept; \
+    void correct_frame(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const float* tmpplab, \
+        float* rows, const std::pair<float, float>& avg, const int width, const int height) noexcept; \
+    void convert_frame_tiled(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, \
+        float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept; \
+    void correct_frame_tiled(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, float* rows, \
+        const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg, float* line_sum, \
+        int* line_count_pels, const int width, const int height) noexcept; \
+    void correct_frame_onepass(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, \
+        float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg, \
+        float* line_sum, int* line_count_pels, const int width, const int height) noexcept; \
+}
+
+GRAYWORLD_FMV_DECLARE(grayworld_x86_64)
+GRAYWORLD_FMV_DECLARE(grayworld_x86_64_v2)
+GRAYWORLD_FMV_DECLARE(grayworld_x86_64_v3)
+GRAYWORLD_FMV_DECLARE(grayworld_x86_64_v4)
+
+struct grayworld_frame_fns
+{
+    decltype(&::convert_frame) convert;
+    decltype(&::correct_frame) correct;
+    decltype(&::convert_frame_tiled) convert_tiled;
+    decltype(&::correct_frame_tiled) correct_tiled;
+    decltype(&::correct_frame_onepass) correct_onepass;
+    decltype(&::compute_correction<grayworld_mode::mean>) mean;
+    decltype(&::compute_correction<grayworld_mode::median>) median;
+};
+
+#define GRAYWORLD_FMV_FNS(level) \
+    { level::convert_frame, level::correct_frame, level::convert_frame_tiled, level::correct_frame_tiled, level::correct_frame_onepass, \
+        level::compute_correction<grayworld_mode::mean>, level::compute_correction<grayworld_mode::median> }
+
+static const grayworld_frame_fns* select_frame_fns() noexcept
+{
+    static constexpr grayworld_frame_fns fns[4]{
+        GRAYWORLD_FMV_FNS(grayworld_x86_64),
+        GRAYWORLD_FMV_FNS(grayworld_x86_64_v2),
+        GRAYWORLD_FMV_FNS(grayworld_x86_64_v3),
+        GRAYWORLD_FMV_FNS(grayworld_x86_64_v4)
+    };
+
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("x86-64-v4"))
+        return &fns[3];
+    if (__builtin_cpu_supports("x86-64-v3"))
+        return &fns[2];
+    if (__builtin_cpu_supports("x86-64-v2"))
+        return &fns[1];
+
+    return &fns[0];
+}
+
+static const grayworld_frame_fns* const frame_fns{ select_frame_fns() };
+
+template <grayworld_mode mode>
+std::pair<float, float> compute_correction(float* line_sum, int* line_count_pels, const int height) noexcept
+{
+    if constexpr (mode == grayworld_mode::mean)
+        return frame_fns->mean(line_sum, line_count_pels, height);
+    else
+        return frame_fns->median(line_sum, line_count_pels, height);
+}
+
+template std::pair<float, float> compute_correction<grayworld_mode::mean>(float* line_sum, int* line_count_pels, const int height) noexcept;
+template std::pair<float, float> compute_correction<grayworld_mode::median>(float* line_sum, int* line_count_pels, const int height) noexcept;
+
+void convert_frame(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict tmpplab, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    frame_fns->convert(k, mode, input, yuv, tmpplab, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
+}
+
+void correct_frame(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const float* tmpplab,
+    float* rows, const std::pair<float, float>& avg, const int width, const int height) noexcept
+{
+    frame_fns->correct(k, input, yuv, dstp, dst_pitch, tmpplab, rows, avg, width, height);
+}
+
+void convert_frame_tiled(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    frame_fns->convert_tiled(k, mode, input, yuv, strip, strip_height, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
+}
+
+void correct_frame_tiled(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg, float* line_sum,
+    int* line_count_pels, const int width, const int height) noexcept
+{
+    frame_fns->correct_tiled(k, input, yuv, strip, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+}
+
+void correct_frame_onepass(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg,
+    float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    frame_fns->correct_onepass(k, mode, input, yuv, strip, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+}
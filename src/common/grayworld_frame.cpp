@@ -0,0 +1,565 @@
+#include <memory>
+#include <type_traits>
+
+#include "grayworld_core.h"
+#include "thread_pool.h"
+
+// The per-frame part of the filter. The multiversioned build (BUILD_FMV) compiles this file once per x86-64 level,
+// every copy in the namespace GRAYWORLD_FMV_CLONE, and grayworld_fmv.cpp forwards to the copy of the CPU.
+#ifdef GRAYWORLD_FMV_CLONE
+namespace GRAYWORLD_FMV_CLONE
+{
+#endif
+
+// The std templates that aren't inlined are instantiated with local types.
+// Otherwise the linker keeps one copy of them for every level of the multiversioned build.
+namespace
+{
+    struct float_less
+    {
+        bool operator()(const float a, const float b) const noexcept
+        {
+            return a < b;
+        }
+    };
+
+    template <typename T>
+    struct local_allocator : std::allocator<T>
+    {
+        template <typename U>
+        struct rebind
+        {
+            using other = local_allocator<U>;
+        };
+
+        local_allocator() noexcept = default;
+
+        template <typename U>
+        local_allocator(const local_allocator<U>&) noexcept
+        {
+        }
+    };
+
+    using float_vector = std::vector<float, local_allocator<float>>;
+}
+
+template <grayworld_mode mode>
+std::pair<float, float> compute_correction(float* line_sum, int* line_count_pels, const int height) noexcept
+{
+    if constexpr (mode == grayworld_mode::mean)
+    {
+        float asum{ 0.0f };
+        float bsum{ 0.0f };
+        int64_t pixels{ 0 };
+
+        for (int y{ 0 }; y < height; ++y)
+        {
+            asum += line_sum[y];
+            bsum += line_sum[y + height];
+            pixels += line_count_pels[y];
+        }
+
+        return std::make_pair<float, float>(asum / pixels, bsum / pixels);
+    }
+    else
+    {
+        float_vector am;
+        am.reserve(height);
+        float_vector bm;
+        bm.reserve(height);
+
+        for (int y{ 0 }; y < height; ++y)
+        {
+            am.emplace_back(line_sum[y]);
+            bm.emplace_back(line_sum[y + height]);
+        }
+
+        const auto middleItr{ am.begin() + am.size() / 2 };
+        std::nth_element(am.begin(), middleItr, am.end(), float_less{});
+
+        const auto middleItr1{ bm.begin() + bm.size() / 2 };
+        std::nth_element(bm.begin(), middleItr1, bm.end(), float_less{});
+
+        return std::make_pair<float, float>((am.size() % 2 == 0) ? ((*(std::max_element(am.begin(), middleItr, float_less{})) + *middleItr) / 2) : *middleItr,
+            (bm.size() % 2 == 0) ? ((*(std::max_element(bm.begin(), middleItr1, float_less{})) + *middleItr1) / 2) : *middleItr1);
+    }
+}
+
+template std::pair<float, float> compute_correction<grayworld_mode::mean>(float* line_sum, int* line_count_pels, const int height) noexcept;
+template std::pair<float, float> compute_correction<grayworld_mode::median>(float* line_sum, int* line_count_pels, const int height) noexcept;
+
+static float median(float* first, float* last) noexcept
+{
+    const auto middleItr{ first + (last - first) / 2 };
+    std::nth_element(first, middleItr, last, float_less{});
+
+    return ((last - first) % 2 == 0) ? ((*(std::max_element(first, middleItr, float_less{})) + *middleItr) / 2) : *middleItr;
+}
+
+// Y is converted to 0..1 and chroma to -0.5..0.5. Integer samples are limited range unless full is set.
+template <typename T>
+static void load_row(const uint8_t* src, float* __restrict dst, const int width, const int bits, const bool chroma, const bool full) noexcept
+{
+    const T* s{ reinterpret_cast<const T*>(src) };
+
+    if constexpr (std::is_same_v<T, float>)
+        std::copy(s, s + width, dst);
+    else
+    {
+        const float offset{ static_cast<float>((full) ? (chroma ? 1 << (bits - 1) : 0) : (chroma ? 128 : 16) << (bits - 8)) };
+        const float scale{ 1.0f / ((full) ? (1 << bits) - 1 : (chroma ? 224 : 219) << (bits - 8)) };
+
+        for (int x{ 0 }; x < width; ++x)
+            dst[x] = (s[x] - offset) * scale;
+    }
+}
+
+template <typename T>
+static void store_row(const float* src, uint8_t* dst, const int width, const int bits, const bool chroma, const bool full) noexcept
+{
+    T* d{ reinterpret_cast<T*>(dst) };
+
+    if constexpr (std::is_same_v<T, float>)
+        std::copy(src, src + width, d);
+    else
+    {
+        const float offset{ static_cast<float>((full) ? (chroma ? 1 << (bits - 1) : 0) : (chroma ? 128 : 16) << (bits - 8)) + 0.5f };
+        const float scale{ static_cast<float>((full) ? (1 << bits) - 1 : (chroma ? 224 : 219) << (bits - 8)) };
+        const float peak{ static_cast<float>((1 << bits) - 1) };
+
+        for (int x{ 0 }; x < width; ++x)
+            d[x] = static_cast<T>(std::clamp(src[x] * scale + offset, 0.0f, peak));
+    }
+}
+
+// A part of the row buffers, rounded up to 64 bytes as by row_scratch_size.
+static size_t row_part(const size_t n) noexcept
+{
+    return (n + 15) & ~size_t{ 15 };
+}
+
+static int lab_step(const grayworld_layout layout) noexcept
+{
+    return (layout == grayworld_layout::planar) ? lab_block : 3 * lab_block;
+}
+
+// Returns the L, a, b pointers of row y of a scratch that starts with row y0.
+template <typename T>
+static void lab_row(const grayworld_kernels& k, T* lab, const ptrdiff_t plane_stride, const int width, const int y, const int y0, T*& l_lab, T*& a_lab, T*& b_lab) noexcept
+{
+    if (k.layout == grayworld_layout::planar)
+    {
+        l_lab = lab + static_cast<ptrdiff_t>(y - y0) * width;
+        a_lab = l_lab + plane_stride;
+        b_lab = l_lab + 2 * plane_stride;
+    }
+    else
+    {
+        l_lab = lab + static_cast<ptrdiff_t>(y - y0) * lab_row_size(width, k.layout);
+        a_lab = l_lab + lab_block;
+        b_lab = l_lab + 2 * lab_block;
+    }
+}
+
+// Converts the float LAB row in buf (one row in the scratch layout) to row y of a fp16 scratch and back.
+static void store_half_row(const grayworld_kernels& k, const float* buf, uint16_t* lab, const ptrdiff_t plane_stride, const int width, const int y, const int y0) noexcept
+{
+    uint16_t* l_lab;
+    uint16_t* a_lab;
+    uint16_t* b_lab;
+    lab_row(k, lab, plane_stride, width, y, y0, l_lab, a_lab, b_lab);
+
+    if (k.layout == grayworld_layout::planar)
+    {
+        k.float_to_half_row(buf, l_lab, width);
+        k.float_to_half_row(buf + width, a_lab, width);
+        k.float_to_half_row(buf + 2 * width, b_lab, width);
+    }
+    else
+        k.float_to_half_row(buf, l_lab, lab_row_size(width, k.layout));
+}
+
+static void load_half_row(const grayworld_kernels& k, const uint16_t* lab, float* buf, const ptrdiff_t plane_stride, const int width, const int y, const int y0) noexcept
+{
+    const uint16_t* l_lab;
+    const uint16_t* a_lab;
+    const uint16_t* b_lab;
+    lab_row(k, lab, plane_stride, width, y, y0, l_lab, a_lab, b_lab);
+
+    if (k.layout == grayworld_layout::planar)
+    {
+        k.half_to_float_row(l_lab, buf, width);
+        k.half_to_float_row(a_lab, buf + width, width);
+        k.half_to_float_row(b_lab, buf + 2 * width, width);
+    }
+    else
+        k.half_to_float_row(l_lab, buf, lab_row_size(width, k.layout));
+}
+
+// Converts rows y0..y1 to LAB. lab starts with row lab_y0, for the planar layout row y is stored at lab + (y - lab_y0) * width, the a/b planes follow at plane_stride intervals.
+// rows: the row buffers of the band (row_scratch_size).
+static void convert_rows(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict lab, const ptrdiff_t plane_stride,
+    const int lab_y0, float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height, const int y0,
+    const int y1) noexcept
+{
+    // fp16 scratch rows are converted in lab_buf
+    float* lab_buf{ rows };
+    // non-planar rgb rows are converted into rgb_buf, the median mode needs a copy of the a/b row
+    float* rgb_buf{ lab_buf + ((k.precision == grayworld_precision::fp16) ? row_part(lab_row_size(width, k.layout)) : 0) };
+    float* m{ rgb_buf + ((input != grayworld_input::planar) ? row_part(3 * static_cast<size_t>(width)) : 0) };
+    // full resolution Y, U, V rows and two chroma resolution rows
+    float* yuv_buf{ m + row_part(2 * static_cast<size_t>(width)) };
+
+    const auto load{ (yuv.bits == 32) ? load_row<float> : ((yuv.bits > 8) ? load_row<uint16_t> : load_row<uint8_t>) };
+    const int chroma_width{ (width + yuv.ss_w) >> yuv.ss_w };
+    const int chroma_height{ (height + yuv.ss_h) >> yuv.ss_h };
+
+    // left/top left: horizontally co-sited with the even columns, otherwise centred between the column pair
+    const bool center_h{ yuv.chroma_location == 1 || yuv.chroma_location == 3 };
+    // top left/top: vertically co-sited with the even rows, otherwise centred between the row pair
+    const bool top{ yuv.chroma_location == 2 || yuv.chroma_location == 3 };
+
+    // upsamples the chroma of row y
+    auto upsample_chroma{ [&](const int plane, const int y, float* __restrict dst)
+    {
+        float* c0{ yuv_buf + 3 * width };
+        float* c1{ yuv_buf + 4 * width };
+
+        if (yuv.ss_h && top)
+        {
+            const int cy{ y >> 1 };
+
+            load(srcp[plane] + cy * src_pitch[plane], c0, chroma_width, yuv.bits, true, yuv.full_range);
+
+            if (y & 1)
+            {
+                load(srcp[plane] + std::min(cy + 1, chroma_height - 1) * src_pitch[plane], c1, chroma_width, yuv.bits, true, yuv.full_range);
+
+                for (int x{ 0 }; x < chroma_width; ++x)
+                    c0[x] = 0.5f * (c0[x] + c1[x]);
+            }
+        }
+        else if (yuv.ss_h)
+        {
+            const int cy{ y >> 1 };
+            const int cy1{ std::clamp((y & 1) ? cy + 1 : cy - 1, 0, chroma_height - 1) };
+
+            load(srcp[plane] + cy * src_pitch[plane], c0, chroma_width, yuv.bits, true, yuv.full_range);
+            load(srcp[plane] + cy1 * src_pitch[plane], c1, chroma_width, yuv.bits, true, yuv.full_range);
+
+            for (int x{ 0 }; x < chroma_width; ++x)
+                c0[x] = 0.75f * c0[x] + 0.25f * c1[x];
+        }
+        else
+            load(srcp[plane] + y * src_pitch[plane], c0, chroma_width, yuv.bits, true, yuv.full_range);
+
+        if (yuv.ss_w && center_h)
+        {
+            for (int x{ 0 }; x < width; ++x)
+                dst[x] = 0.75f * c0[x >> 1] + 0.25f * c0[std::clamp((x & 1) ? (x >> 1) + 1 : (x >> 1) - 1, 0, chroma_width - 1)];
+        }
+        else if (yuv.ss_w)
+        {
+            for (int x{ 0 }; x < width; ++x)
+                dst[x] = (x & 1) ? 0.5f * (c0[x >> 1] + c0[std::min((x >> 1) + 1, chroma_width - 1)]) : c0[x >> 1];
+        }
+        else
+            std::copy(c0, c0 + width, dst);
+    } };
+
+    for (int y{ y0 }; y < y1; ++y)
+    {
+        float* lcur;
+        float* acur;
+        float* bcur;
+        if (k.precision == grayworld_precision::fp16)
+            lab_row(k, lab_buf, width, width, y, y, lcur, acur, bcur);
+        else
+            lab_row(k, lab, plane_stride, width, y, lab_y0, lcur, acur, bcur);
+
+        const float* r;
+        const float* g;
+        const float* b;
+
+        if (input == grayworld_input::planar)
+        {
+            r = reinterpret_cast<const float*>(srcp[0] + y * src_pitch[0]);
+            g = reinterpret_cast<const float*>(srcp[1] + y * src_pitch[1]);
+            b = reinterpret_cast<const float*>(srcp[2] + y * src_pitch[2]);
+        }
+        else
+        {
+            if (input == grayworld_input::yuv)
+            {
+                load(srcp[0] + y * src_pitch[0], yuv_buf, width, yuv.bits, false, yuv.full_range);
+                upsample_chroma(1, y, yuv_buf + width);
+                upsample_chroma(2, y, yuv_buf + 2 * width);
+
+                k.yuv_to_rgb_row(yuv_buf, yuv_buf + width, yuv_buf + 2 * width, rgb_buf, rgb_buf + width, rgb_buf + 2 * width, yuv, width);
+            }
+            else
+                k.unpack_row(srcp[0] + y * src_pitch[0], rgb_buf, rgb_buf + width, rgb_buf + 2 * width, width);
+
+            r = rgb_buf;
+            g = rgb_buf + width;
+            b = rgb_buf + 2 * width;
+        }
+
+        float a_sum{ 0.0f };
+        float b_sum{ 0.0f };
+
+        if (k.precision == grayworld_precision::fp16)
+            k.convert_row(r, g, b, lcur, acur, bcur, width, lab_step(k.layout), a_sum, b_sum);
+        else
+            k.convert_row_frame(r, g, b, lcur, acur, bcur, width, lab_step(k.layout), a_sum, b_sum);
+
+        if (k.precision == grayworld_precision::fp16)
+            store_half_row(k, lab_buf, reinterpret_cast<uint16_t*>(lab), plane_stride, width, y, lab_y0);
+
+        if (mode == grayworld_mode::mean)
+        {
+            line_sum[y] = a_sum;
+            line_sum[y + height] = b_sum;
+        }
+        else
+        {
+            if (k.layout == grayworld_layout::planar)
+            {
+                std::copy(acur, acur + width, m);
+                std::copy(bcur, bcur + width, m + width);
+            }
+            else
+            {
+                for (int x{ 0 }; x < width; ++x)
+                {
+                    const int i{ lab_offset(x, 3 * lab_block) };
+                    m[x] = acur[i];
+                    m[width + x] = bcur[i];
+                }
+            }
+
+            line_sum[y] = median(m, m + width);
+            line_sum[y + height] = median(m + width, m + 2 * width);
+        }
+
+        line_count_pels[y] = width;
+    }
+}
+
+// Corrects rows y0..y1 stored as by convert_rows.
+static void correct_rows(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const float* lab,
+    const ptrdiff_t plane_stride, const int lab_y0, float* rows, const std::pair<float, float>& avg, const int width, const int height, const int y0, const int y1) noexcept
+{
+    float* lab_buf{ rows };
+
+    // returns the float L, a, b pointers of row y
+    auto load_lab{ [&](const int y, const float*& lcur, const float*& acur, const float*& bcur)
+    {
+        if (k.precision == grayworld_precision::fp16)
+        {
+            load_half_row(k, reinterpret_cast<const uint16_t*>(lab), lab_buf, plane_stride, width, y, lab_y0);
+            lab_row(k, static_cast<const float*>(lab_buf), width, width, y, y, lcur, acur, bcur);
+        }
+        else
+            lab_row(k, lab, plane_stride, width, y, lab_y0, lcur, acur, bcur);
+    } };
+
+    if (input != grayworld_input::yuv)
+    {
+        for (int y{ y0 }; y < y1; ++y)
+        {
+            const float* lcur;
+            const float* acur;
+            const float* bcur;
+            load_lab(y, lcur, acur, bcur);
+
+            k.correct_row_frame(lcur, acur, bcur, reinterpret_cast<float*>(dstp[0] + y * dst_pitch[0]), reinterpret_cast<float*>(dstp[1] + y * dst_pitch[1]),
+                reinterpret_cast<float*>(dstp[2] + y * dst_pitch[2]), avg, width, lab_step(k.layout), k.prefetch);
+        }
+
+        return;
+    }
+
+    // linear rgb row, Y row, two full resolution U/V rows and one chroma resolution row
+    float* rgb{ lab_buf + ((k.precision == grayworld_precision::fp16) ? row_part(lab_row_size(width, k.layout)) : 0) };
+    float* ybuf{ rgb + 3 * width };
+    float* ubuf{ rgb + 4 * width };
+    float* vbuf{ rgb + 6 * width };
+    float* cbuf{ rgb + 8 * width };
+
+    const auto store{ (yuv.bits == 32) ? store_row<float> : ((yuv.bits > 8) ? store_row<uint16_t> : store_row<uint8_t>) };
+    const int chroma_width{ (width + yuv.ss_w) >> yuv.ss_w };
+
+    const bool center_h{ yuv.chroma_location == 1 || yuv.chroma_location == 3 };
+    const bool top{ yuv.chroma_location == 2 || yuv.chroma_location == 3 };
+
+    // downsamples the chroma of the current row (pair) to the siting of upsample_chroma,
+    // vertically co-sited chroma takes the even row (the row above belongs to the previous band)
+    auto downsample_chroma{ [&](const int plane, float* src, const bool pair, const int cy)
+    {
+        if (pair && !top)
+        {
+            for (int x{ 0 }; x < width; ++x)
+                src[x] = 0.5f * (src[x] + src[x + width]);
+        }
+
+        if (yuv.ss_w && center_h)
+        {
+            for (int x{ 0 }; x < chroma_width; ++x)
+                cbuf[x] = 0.5f * (src[2 * x] + src[std::min(2 * x + 1, width - 1)]);
+
+            store(cbuf, dstp[plane] + cy * dst_pitch[plane], chroma_width, yuv.bits, true, yuv.full_range);
+        }
+        else if (yuv.ss_w)
+        {
+            for (int x{ 0 }; x < chroma_width; ++x)
+                cbuf[x] = 0.25f * src[std::max(2 * x - 1, 0)] + 0.5f * src[2 * x] + 0.25f * src[std::min(2 * x + 1, width - 1)];
+
+            store(cbuf, dstp[plane] + cy * dst_pitch[plane], chroma_width, yuv.bits, true, yuv.full_range);
+        }
+        else
+            store(src, dstp[plane] + cy * dst_pitch[plane], width, yuv.bits, true, yuv.full_range);
+    } };
+
+    for (int y{ y0 }; y < y1; ++y)
+    {
+        const float* lcur;
+        const float* acur;
+        const float* bcur;
+        load_lab(y, lcur, acur, bcur);
+        const int py{ yuv.ss_h ? (y & 1) : 0 };
+
+        k.correct_row(lcur, acur, bcur, rgb, rgb + width, rgb + 2 * width, avg, width, lab_step(k.layout), k.prefetch);
+        k.rgb_to_yuv_row(rgb, rgb + width, rgb + 2 * width, ybuf, ubuf + py * width, vbuf + py * width, yuv, width);
+
+        store(ybuf, dstp[0] + y * dst_pitch[0], width, yuv.bits, false, yuv.full_range);
+
+        if (!yuv.ss_h || py == 1 || y == height - 1)
+        {
+            downsample_chroma(1, ubuf, py == 1, y >> yuv.ss_h);
+            downsample_chroma(2, vbuf, py == 1, y >> yuv.ss_h);
+        }
+    }
+}
+
+// Runs fn(y0, y1, band) for the k.bands row ranges of the frame on the shared pool. The ranges are multiples of step rows.
+template <typename F>
+static void run_bands(const grayworld_kernels& k, const int height, const int step, F fn) noexcept
+{
+    const int units{ (height + step - 1) / step };
+    const int bands{ std::clamp(k.bands, 1, std::max(units, 1)) };
+
+    if (bands == 1)
+    {
+        fn(0, height, 0);
+        return;
+    }
+
+    struct band_context
+    {
+        F& fn;
+        int units;
+        int bands;
+        int step;
+        int height;
+    } ctx{ fn, units, bands, step, height };
+
+    thread_pool::shared().run(bands, [](void* p, const int band)
+        {
+            const band_context& c{ *static_cast<const band_context*>(p) };
+            c.fn(std::min(band * c.units / c.bands * c.step, c.height), std::min((band + 1) * c.units / c.bands * c.step, c.height), band);
+        }, &ctx);
+}
+
+void convert_frame(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict tmpplab, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    run_bands(k, height, 2, [&](const int y0, const int y1, const int band)
+        {
+            float* band_rows{ rows + band * row_scratch_size(k, input, width) };
+
+            convert_rows(k, mode, input, yuv, tmpplab, static_cast<ptrdiff_t>(width) * height, 0, band_rows, srcp, src_pitch, line_sum, line_count_pels, width, height, y0, y1);
+        });
+}
+
+void correct_frame(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const float* tmpplab,
+    float* rows, const std::pair<float, float>& avg, const int width, const int height) noexcept
+{
+    // the bands start at even rows, the 4:2:0 chroma rows are written per row pair
+    run_bands(k, height, 2, [&](const int y0, const int y1, const int band)
+        {
+            float* band_rows{ rows + band * row_scratch_size(k, input, width) };
+
+            correct_rows(k, input, yuv, dstp, dst_pitch, tmpplab, static_cast<ptrdiff_t>(width) * height, 0, band_rows, avg, width, height, y0, y1);
+        });
+}
+
+void convert_frame_tiled(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    // the strip is read back while it is cached, it is never streamed
+    grayworld_kernels kt{ k };
+    kt.convert_row_frame = k.convert_row;
+
+    run_bands(k, height, strip_height, [&](const int y0, const int y1, const int band)
+        {
+            float* band_strip{ strip + band * lab_scratch_size(k, width, strip_height) };
+            float* band_rows{ rows + band * row_scratch_size(k, input, width) };
+
+            for (int y{ y0 }; y < y1; y += strip_height)
+                convert_rows(kt, mode, input, yuv, band_strip, static_cast<ptrdiff_t>(width) * strip_height, y, band_rows, srcp, src_pitch, line_sum, line_count_pels, width,
+                    height, y, std::min(y + strip_height, y1));
+        });
+}
+
+void correct_frame_tiled(const grayworld_kernels& k, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height, float* rows,
+    const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg, float* line_sum,
+    int* line_count_pels, const int width, const int height) noexcept
+{
+    grayworld_kernels kt{ k };
+    kt.convert_row_frame = k.convert_row;
+
+    run_bands(k, height, strip_height, [&](const int y0, const int y1, const int band)
+        {
+            float* band_strip{ strip + band * lab_scratch_size(k, width, strip_height) };
+            float* band_rows{ rows + band * row_scratch_size(k, input, width) };
+
+            for (int y{ y0 }; y < y1; y += strip_height)
+            {
+                const int y2{ std::min(y + strip_height, y1) };
+
+                // the row statistics are already known, mean mode only recomputes the sums
+                convert_rows(kt, grayworld_mode::mean, input, yuv, band_strip, static_cast<ptrdiff_t>(width) * strip_height, y, band_rows, srcp, src_pitch, line_sum, line_count_pels,
+                    width, height, y, y2);
+                correct_rows(kt, input, yuv, dstp, dst_pitch, band_strip, static_cast<ptrdiff_t>(width) * strip_height, y, band_rows, avg, width, height, y, y2);
+            }
+        });
+}
+
+void correct_frame_onepass(const grayworld_kernels& k, const grayworld_mode mode, const grayworld_input input, const grayworld_yuv& yuv, float* __restrict strip, const int strip_height,
+    float* rows, const uint8_t* const srcp[3], const ptrdiff_t src_pitch[3], uint8_t* const dstp[3], const ptrdiff_t dst_pitch[3], const std::pair<float, float>& avg,
+    float* line_sum, int* line_count_pels, const int width, const int height) noexcept
+{
+    grayworld_kernels kt{ k };
+    kt.convert_row_frame = k.convert_row;
+
+    // every strip is read once, the statistics of this frame are gathered while the previous offsets are applied
+    run_bands(k, height, strip_height, [&](const int y0, const int y1, const int band)
+        {
+            float* band_strip{ strip + band * lab_scratch_size(k, width, strip_height) };
+            float* band_rows{ rows + band * row_scratch_size(k, input, width) };
+
+            for (int y{ y0 }; y < y1; y += strip_height)
+            {
+                const int y2{ std::min(y + strip_height, y1) };
+
+                convert_rows(kt, mode, input, yuv, band_strip, static_cast<ptrdiff_t>(width) * strip_height, y, band_rows, srcp, src_pitch, line_sum, line_count_pels,
+                    width, height, y, y2);
+                correct_rows(kt, input, yuv, dstp, dst_pitch, band_strip, static_cast<ptrdiff_t>(width) * strip_height, y, band_rows, avg, width, height, y, y2);
+            }
+        });
+}
+
+#ifdef GRAYWORLD_FMV_CLONE
+}
+#endif
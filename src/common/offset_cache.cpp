@@ -0,0 +1,63 @@
+#include "offset_cache.h"
+
+offset_cache::in_flight::in_flight(offset_cache& cache, const int n) noexcept : cache(&cache), n(n)
+{
+    const std::lock_guard<std::mutex> lock{ cache.mutex };
+    slot& s{ cache.entries[n % capacity] };
+
+    // a frame that is already cached keeps its offsets
+    if (s.e.n != n)
+        s = { { n, {}, 0 }, true };
+}
+
+offset_cache::in_flight::~in_flight()
+{
+    cache->withdraw(n);
+}
+
+offset_cache::offset_cache() noexcept
+{
+    for (slot& s : entries)
+        s = { { -1, {}, 0 }, false };
+}
+
+bool offset_cache::find(const int n, entry& result, bool& waited) const noexcept
+{
+    std::unique_lock<std::mutex> lock{ mutex };
+    const slot& s{ entries[n % capacity] };
+
+    waited = s.e.n == n && s.pending;
+    // the slot is reused by a later frame or the frame is withdrawn when it changes
+    ready.wait(lock, [&] { return s.e.n != n || !s.pending; });
+
+    if (s.e.n != n)
+        return false;
+
+    result = s.e;
+    return true;
+}
+
+void offset_cache::insert(const entry& e) noexcept
+{
+    {
+        const std::lock_guard<std::mutex> lock{ mutex };
+        entries[e.n % capacity] = { e, false };
+    }
+    ready.notify_all();
+}
+
+void offset_cache::withdraw(const int n) noexcept
+{
+    {
+        const std::lock_guard<std::mutex> lock{ mutex };
+        slot& s{ entries[n % capacity] };
+
+        // nothing to do after insert()
+        if (s.e.n != n || !s.pending)
+            return;
+
+        s.e.n = -1;
+        s.pending = false;
+    }
+    ready.notify_all();
+}
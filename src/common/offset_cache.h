@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+// Thread-safe cache of the correction offsets of recently processed frames (latency=1).
+// Direct mapped by frame number, a lookup of an evicted frame misses and the caller recomputes it.
+// A frame that is being processed is published as in flight, the lookups of it wait for its offsets instead of missing.
+class offset_cache
+{
+public:
+    struct entry
+    {
+        int n;
+        std::pair<float, float> avg;
+        int64_t pixels;
+    };
+
+    // Publishes frame n as in flight until insert() stores its offsets. When it is destroyed before
+    // (an error), the frame is withdrawn and the waiting lookups miss.
+    class in_flight
+    {
+        offset_cache* cache;
+        int n;
+
+    public:
+        in_flight(offset_cache& cache, const int n) noexcept;
+        in_flight(const in_flight&) = delete;
+        in_flight& operator=(const in_flight&) = delete;
+        ~in_flight();
+    };
+
+    offset_cache() noexcept;
+
+    // False when frame n is not cached. Waits while frame n is in flight, waited is set when it did.
+    bool find(const int n, entry& result, bool& waited) const noexcept;
+    void insert(const entry& e) noexcept;
+
+private:
+    struct slot
+    {
+        entry e;
+        bool pending;
+    };
+
+    static constexpr int capacity{ 64 };
+
+    void withdraw(const int n) noexcept;
+
+    mutable std::mutex mutex;
+    mutable std::condition_variable ready;
+    slot entries[capacity];
+};
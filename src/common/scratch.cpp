@@ -0,0 +1,322 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "scratch.h"
+
+static constexpr size_t scratch_alignment{ 64 };
+static constexpr size_t huge_page_size{ 2 * 1024 * 1024 };
+
+void* scratch_alloc_bytes(const size_t bytes, const bool huge_pages, scratch_deleter& deleter) noexcept
+{
+    deleter.mapped_size = 0;
+
+    if (bytes == 0)
+        return nullptr;
+
+#if defined(_WIN32)
+    if (huge_pages)
+    {
+        const size_t large_page{ GetLargePageMinimum() };
+
+        if (large_page)
+        {
+            const size_t size{ (bytes + large_page - 1) / large_page * large_page };
+
+            if (void* p{ VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE) })
+            {
+                deleter.mapped_size = size;
+                return p;
+            }
+        }
+
+        // committed but untouched pages are only backed on the first write
+        if (void* p{ VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE) })
+        {
+            deleter.mapped_size = bytes;
+            return p;
+        }
+
+        return nullptr;
+    }
+
+    return _aligned_malloc(bytes, scratch_alignment);
+#else
+    if (huge_pages)
+    {
+        // map one huge page more than needed so the range can be trimmed to a 2 MiB aligned one that THP can back
+        const size_t size{ (bytes + huge_page_size - 1) / huge_page_size * huge_page_size };
+        void* map{ mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+
+        if (map == MAP_FAILED)
+            return nullptr;
+
+        uint8_t* base{ static_cast<uint8_t*>(map) };
+        uint8_t* aligned{ reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(base) + huge_page_size - 1) & ~(huge_page_size - 1)) };
+
+        if (aligned > base)
+            munmap(base, aligned - base);
+        if (aligned + size < base + size + huge_page_size)
+            munmap(aligned + size, base + size + huge_page_size - (aligned + size));
+
+#if defined(MADV_HUGEPAGE)
+        madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+
+        deleter.mapped_size = size;
+        return aligned;
+    }
+
+    void* p{ nullptr };
+    if (posix_memalign(&p, scratch_alignment, bytes))
+        return nullptr;
+
+    return p;
+#endif
+}
+
+void scratch_deleter::operator()(void* p) const noexcept
+{
+    if (!p)
+        return;
+
+#if defined(_WIN32)
+    if (mapped_size)
+        VirtualFree(p, 0, MEM_RELEASE);
+    else
+        _aligned_free(p);
+#else
+    if (mapped_size)
+        munmap(p, mapped_size);
+    else
+        free(p);
+#endif
+}
+
+scratch_pool::scratch_pool(const size_t lab_size, const int height, const size_t row_bytes, const bool huge_pages) noexcept
+    : allocated(0), leased(0), period_peak(0), high_water(0), lab_size(lab_size), height(height), row_bytes(row_bytes), huge_pages(huge_pages)
+{
+}
+
+scratch_pool::lease scratch_pool::acquire() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!free_entries.empty())
+        {
+            std::unique_ptr<frame_scratch> entry{ std::move(free_entries.back()) };
+            free_entries.pop_back();
+            period_peak = std::max(period_peak, ++leased);
+
+            return lease(this, std::move(entry));
+        }
+    }
+
+    // allocated outside of the lock, the LAB scratch is neither zeroed nor touched here
+    std::unique_ptr<frame_scratch> entry;
+
+    try
+    {
+        entry = std::make_unique<frame_scratch>();
+        entry->lab = scratch_alloc<float>(lab_size, huge_pages);
+        if (!entry->lab)
+            return lease(this, nullptr);
+
+        // the row buffers are small, they never use huge pages
+        entry->rows = scratch_alloc<float>(row_bytes / sizeof(float), false);
+        if (row_bytes && !entry->rows)
+            return lease(this, nullptr);
+
+        entry->line_count_pels = std::make_unique<int[]>(height);
+        entry->line_sum = std::make_unique<float[]>(height * 2);
+    }
+    catch (...)
+    {
+        return lease(this, nullptr);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // release() never has to grow the free list
+    try
+    {
+        free_entries.reserve(allocated + 1);
+    }
+    catch (...)
+    {
+        return lease(this, nullptr);
+    }
+
+    ++allocated;
+    period_peak = std::max(period_peak, ++leased);
+
+    return lease(this, std::move(entry));
+}
+
+size_t scratch_pool::size() const noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return allocated;
+}
+
+size_t scratch_pool::bytes() const noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return allocated * (sizeof(float) * (lab_size + static_cast<size_t>(height) * 2) + sizeof(int) * height + row_bytes);
+}
+
+void scratch_pool::release(std::unique_ptr<frame_scratch> entry) noexcept
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    free_entries.emplace_back(std::move(entry));
+
+    if (--leased)
+        return;
+
+    // the mark decays by one entry per idle period, at most that entry is beyond it
+    high_water = std::max(period_peak, (high_water) ? high_water - 1 : 0);
+    period_peak = 0;
+
+    if (free_entries.size() > high_water)
+    {
+        entry = std::move(free_entries.back());
+        free_entries.pop_back();
+        --allocated;
+        // released outside of the lock
+        lock.unlock();
+    }
+}
+
+bool scratch_pool::idle() const noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return free_entries.size() == allocated;
+}
+
+void scratch_pool::trim(const size_t keep) noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    while (free_entries.size() > keep)
+    {
+        free_entries.pop_back();
+        --allocated;
+    }
+
+    high_water = std::min(high_water, allocated);
+}
+
+scratch_cache::scratch_cache(const size_t max_sizes, const bool huge_pages) noexcept : clock(0), max_sizes((max_sizes) ? max_sizes : 1), huge_pages(huge_pages)
+{
+}
+
+scratch_pool::lease scratch_cache::acquire(const int width, const int height, const size_t lab_size, const size_t row_bytes) noexcept
+{
+    scratch_pool* pool{ nullptr };
+
+    {
+        // the pools are only looked up, created and released under the lock
+        std::lock_guard<std::mutex> lock(mutex);
+        ++clock;
+
+        for (size_pool& p : pools)
+        {
+            if (p.width == width && p.height == height)
+            {
+                p.last_use = clock;
+                ++p.users;
+                pool = p.pool.get();
+                break;
+            }
+        }
+
+        if (!pool)
+        {
+            try
+            {
+                pools.push_back({ width, height, clock, 1, std::make_unique<scratch_pool>(lab_size, height, row_bytes, huge_pages) });
+            }
+            catch (...)
+            {
+                return scratch_pool::lease(nullptr, nullptr);
+            }
+
+            pool = pools.back().pool.get();
+
+            // the new size is the most recently used one, it is never released here
+            while (pools.size() > max_sizes)
+            {
+                auto lru{ pools.end() };
+
+                for (auto it{ pools.begin() }; it != pools.end(); ++it)
+                {
+                    if (it->last_use != clock && !it->users && it->pool->idle() && (lru == pools.end() || it->last_use < lru->last_use))
+                        lru = it;
+                }
+
+                // every other size has frames in flight, they are released by a later call
+                if (lru == pools.end())
+                    break;
+
+                pools.erase(lru);
+            }
+
+            // the sizes that aren't in use any more keep one entry
+            for (size_pool& p : pools)
+            {
+                if (p.last_use != clock && !p.users && p.pool->idle())
+                    p.pool->trim(1);
+            }
+        }
+    }
+
+    // a new entry is allocated outside of the lock, the frames of the other sizes don't wait for it
+    scratch_pool::lease lease{ pool->acquire() };
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (size_pool& p : pools)
+    {
+        if (p.pool.get() == pool)
+        {
+            --p.users;
+            break;
+        }
+    }
+
+    return lease;
+}
+
+size_t scratch_cache::size() const noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t entries{ 0 };
+
+    for (const size_pool& p : pools)
+        entries += p.pool->size();
+
+    return entries;
+}
+
+size_t scratch_cache::bytes() const noexcept
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes{ 0 };
+
+    for (const size_pool& p : pools)
+        bytes += p.pool->bytes();
+
+    return bytes;
+}
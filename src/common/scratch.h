@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct scratch_deleter
+{
+    // non-zero for page mapped allocations
+    size_t mapped_size;
+
+    void operator()(void* p) const noexcept;
+};
+
+template <typename T>
+using scratch_ptr = std::unique_ptr<T[], scratch_deleter>;
+
+// Allocates uninitialized memory aligned to 64 bytes. Returns nullptr on failure.
+// The memory is not touched, the pages are faulted in (and placed on the NUMA node of) the thread that writes them first.
+// With huge_pages the allocation is backed by transparent huge pages (Linux) or large pages (Windows, requires the "Lock pages in memory" privilege) when possible.
+void* scratch_alloc_bytes(const size_t bytes, const bool huge_pages, scratch_deleter& deleter) noexcept;
+
+template <typename T>
+scratch_ptr<T> scratch_alloc(const size_t n, const bool huge_pages) noexcept
+{
+    scratch_deleter deleter{};
+    T* p{ static_cast<T*>(scratch_alloc_bytes(n * sizeof(T), huge_pages, deleter)) };
+
+    return scratch_ptr<T>(p, deleter);
+}
+
+// The working memory of one frame: the LAB scratch, the row buffers of the core and the per-row statistics.
+struct frame_scratch
+{
+    scratch_ptr<float> lab;
+    scratch_ptr<float> rows;
+    std::unique_ptr<int[]> line_count_pels;
+    std::unique_ptr<float[]> line_sum;
+};
+
+// Thread-safe pool of frame_scratch. acquire() reuses a free entry or allocates a new one,
+// so the pool holds as many entries as frames were processed at the same time.
+// When the last lease is returned the pool keeps the entries of its recent high-water mark: the peak number of leases since it was
+// last idle, or the previous mark minus one when that is larger. The entries of a burst of frames are released one per idle period.
+class scratch_pool
+{
+public:
+    // Returns the entry to the pool when destroyed.
+    class lease
+    {
+        scratch_pool* pool;
+        std::unique_ptr<frame_scratch> entry;
+
+    public:
+        lease(scratch_pool* pool, std::unique_ptr<frame_scratch> entry) noexcept : pool(pool), entry(std::move(entry))
+        {
+        }
+
+        lease(lease&&) noexcept = default;
+        lease& operator=(lease&&) = delete;
+
+        ~lease()
+        {
+            if (entry)
+                pool->release(std::move(entry));
+        }
+
+        frame_scratch* operator->() const noexcept
+        {
+            return entry.get();
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return entry != nullptr;
+        }
+    };
+
+    // lab_size floats of LAB scratch and the statistics of height rows per entry.
+    // row_bytes: the row buffers of the core (sizeof(float) * k.bands * row_scratch_size()), 0 for none.
+    scratch_pool(const size_t lab_size, const int height, const size_t row_bytes, const bool huge_pages) noexcept;
+
+    // The lease is empty when a new entry can't be allocated.
+    lease acquire() noexcept;
+    // The number of entries allocated so far.
+    size_t size() const noexcept;
+    // The memory of the entries allocated so far and of their row buffers.
+    size_t bytes() const noexcept;
+    // True when no entry is leased.
+    bool idle() const noexcept;
+    // Releases the free entries beyond keep.
+    void trim(const size_t keep) noexcept;
+
+private:
+    void release(std::unique_ptr<frame_scratch> entry) noexcept;
+
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<frame_scratch>> free_entries;
+    size_t allocated;
+    size_t leased;
+    // the peak of leased since the pool was last idle and the number of entries kept when it goes idle
+    size_t period_peak;
+    size_t high_water;
+    size_t lab_size;
+    int height;
+    size_t row_bytes;
+    bool huge_pages;
+};
+
+// Thread-safe scratch_pool per frame size for clips whose frames don't all have the same size.
+// The pool of a size is created by its first frame. When more than max_sizes sizes are cached,
+// the least recently used pools without leased entries are released, and the idle pools of the other sizes keep one entry.
+// The cache holds at most max_sizes pools: the entries of the sizes in use (their recent high-water mark, see scratch_pool)
+// and one entry of every idle size.
+class scratch_cache
+{
+public:
+    scratch_cache(const size_t max_sizes, const bool huge_pages) noexcept;
+
+    // An entry for a width x height frame with lab_size floats of LAB scratch (row_bytes: see scratch_pool).
+    // The lease is empty when the memory can't be allocated.
+    scratch_pool::lease acquire(const int width, const int height, const size_t lab_size, const size_t row_bytes) noexcept;
+    // The number of entries allocated for all the cached sizes.
+    size_t size() const noexcept;
+    // The memory of the entries of all the cached sizes (scratch_pool::bytes).
+    size_t bytes() const noexcept;
+
+private:
+    struct size_pool
+    {
+        int width;
+        int height;
+        uint64_t last_use;
+        // the threads between the lookup of the pool and the end of its acquire(), the pool isn't released while they are
+        int users;
+        std::unique_ptr<scratch_pool> pool;
+    };
+
+    mutable std::mutex mutex;
+    std::vector<size_pool> pools;
+    uint64_t clock;
+    size_t max_sizes;
+    bool huge_pages;
+};
@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "stats.h"
+
+static uint64_t now_ns() noexcept
+{
+    // 0 means not set
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()) | 1;
+}
+
+template <typename T>
+static void store_max(std::atomic<T>& a, const T v) noexcept
+{
+    T cur{ a.load(std::memory_order_relaxed) };
+
+    while (v > cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed))
+        ;
+}
+
+void grayworld_stats::begin_frame() noexcept
+{
+    uint64_t unset{ 0 };
+    first_start_ns.compare_exchange_strong(unset, now_ns(), std::memory_order_relaxed);
+
+    store_max(peak_in_flight, in_flight.fetch_add(1, std::memory_order_relaxed) + 1);
+}
+
+void grayworld_stats::add_frame(const uint64_t convert, const uint64_t compute, const uint64_t correct) noexcept
+{
+    convert_ns.fetch_add(convert, std::memory_order_relaxed);
+    compute_ns.fetch_add(compute, std::memory_order_relaxed);
+    correct_ns.fetch_add(correct, std::memory_order_relaxed);
+    frames.fetch_add(1, std::memory_order_relaxed);
+
+    in_flight.fetch_sub(1, std::memory_order_relaxed);
+    store_max(last_end_ns, now_ns());
+}
+
+grayworld_stats::frame_scope::frame_scope(grayworld_stats& stats) noexcept : stats((stats.enabled) ? &stats : nullptr)
+{
+    if (this->stats)
+        this->stats->begin_frame();
+}
+
+grayworld_stats::frame_scope::~frame_scope()
+{
+    if (stats)
+        stats->in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void grayworld_stats::frame_scope::end(const uint64_t convert, const uint64_t compute, const uint64_t correct) noexcept
+{
+    if (stats)
+        stats->add_frame(convert, compute, correct);
+
+    stats = nullptr;
+}
+
+void grayworld_stats::add_scratch(const uint64_t bytes) noexcept
+{
+    store_max(peak_scratch_bytes, bytes);
+}
+
+void grayworld_stats::add_host(const uint64_t alloc, const uint64_t getframe) noexcept
+{
+    alloc_ns.fetch_add(alloc, std::memory_order_relaxed);
+    getframe_ns.fetch_add(getframe, std::memory_order_relaxed);
+    store_max(max_getframe_ns, getframe);
+}
+
+void grayworld_stats::add_offset_lookup(const bool waited, const bool missed) noexcept
+{
+    if (waited)
+        offset_waits.fetch_add(1, std::memory_order_relaxed);
+    if (missed)
+        offset_misses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void grayworld_stats::dump() const noexcept
+{
+    const uint64_t n{ frames.load(std::memory_order_relaxed) };
+    const uint64_t cv{ convert_ns.load(std::memory_order_relaxed) };
+    const uint64_t cp{ compute_ns.load(std::memory_order_relaxed) };
+    const uint64_t cr{ correct_ns.load(std::memory_order_relaxed) };
+    const uint64_t scratch{ peak_scratch_bytes.load(std::memory_order_relaxed) };
+    const uint64_t al{ alloc_ns.load(std::memory_order_relaxed) };
+    const uint64_t gf{ getframe_ns.load(std::memory_order_relaxed) };
+    const uint64_t gf_max{ max_getframe_ns.load(std::memory_order_relaxed) };
+    const uint64_t first{ first_start_ns.load(std::memory_order_relaxed) };
+    const uint64_t last{ last_end_ns.load(std::memory_order_relaxed) };
+    const uint64_t wall{ (first && last > first) ? last - first : 0 };
+    const int peak{ peak_in_flight.load(std::memory_order_relaxed) };
+    const uint64_t waits{ offset_waits.load(std::memory_order_relaxed) };
+    const uint64_t misses{ offset_misses.load(std::memory_order_relaxed) };
+
+    const double fps{ (wall) ? n * 1e9 / wall : 0.0 };
+    const double occupancy{ (wall && peak) ? static_cast<double>(cv + cp + cr) / (static_cast<double>(wall) * peak) : 0.0 };
+
+    const char* path{ std::getenv("GRAYWORLD_DEBUG_FILE") };
+    if (path && *path)
+    {
+        if (FILE* f{ std::fopen(path, "a") })
+        {
+            std::fprintf(f, "{\"filter\":\"grayworld\",\"isa\":\"%s\",\"frames\":%llu,\"convert_ns\":%llu,\"compute_ns\":%llu,\"correct_ns\":%llu,\"peak_scratch_bytes\":%llu,"
+                "\"bands\":%d,\"wall_ns\":%llu,\"fps\":%.3f,\"peak_frames_in_flight\":%d,\"occupancy\":%.3f,\"alloc_ns\":%llu,\"getframe_ns\":%llu,\"max_getframe_ns\":%llu,"
+                "\"latency\":%d,\"offset_waits\":%llu,\"offset_misses\":%llu}\n",
+                isa, static_cast<unsigned long long>(n), static_cast<unsigned long long>(cv), static_cast<unsigned long long>(cp), static_cast<unsigned long long>(cr),
+                static_cast<unsigned long long>(scratch), bands, static_cast<unsigned long long>(wall), fps, peak, occupancy, static_cast<unsigned long long>(al),
+                static_cast<unsigned long long>(gf), static_cast<unsigned long long>(gf_max), latency, static_cast<unsigned long long>(waits),
+                static_cast<unsigned long long>(misses));
+            std::fclose(f);
+            return;
+        }
+    }
+
+    const double div{ (n > 0) ? static_cast<double>(n) * 1e6 : 1e6 };
+    std::fprintf(stderr, "grayworld: isa=%s frames=%llu convert=%.3f ms/frame compute=%.3f ms/frame correct=%.3f ms/frame peak_scratch=%llu bytes\n"
+        "grayworld: bands=%d %.2f fps peak_frames_in_flight=%d occupancy=%.2f alloc=%.3f ms/frame getframe=%.3f ms/frame (max %.3f ms)\n",
+        isa, static_cast<unsigned long long>(n), cv / div, cp / div, cr / div, static_cast<unsigned long long>(scratch), bands, fps, peak, occupancy, al / div, gf / div, gf_max / 1e6);
+
+    if (latency)
+        std::fprintf(stderr, "grayworld: latency=1 previous offsets waited=%llu recomputed=%llu\n", static_cast<unsigned long long>(waits),
+            static_cast<unsigned long long>(misses));
+}
+
+bool grayworld_debug_env() noexcept
+{
+    const char* v{ std::getenv("GRAYWORLD_DEBUG") };
+    return v && *v && std::strcmp(v, "0") != 0;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+struct grayworld_stats
+{
+    // A frame in flight when the stats are enabled: end() adds it, a frame that is left without end() (an error) is withdrawn.
+    class frame_scope
+    {
+        grayworld_stats* stats;
+
+    public:
+        explicit frame_scope(grayworld_stats& stats) noexcept;
+        frame_scope(const frame_scope&) = delete;
+        frame_scope& operator=(const frame_scope&) = delete;
+        ~frame_scope();
+
+        void end(const uint64_t convert, const uint64_t compute, const uint64_t correct) noexcept;
+    };
+
+    std::atomic<uint64_t> convert_ns{ 0 };
+    std::atomic<uint64_t> compute_ns{ 0 };
+    std::atomic<uint64_t> correct_ns{ 0 };
+    std::atomic<uint64_t> frames{ 0 };
+    std::atomic<uint64_t> peak_scratch_bytes{ 0 };
+    // the host side of the frames: allocating the output frame and the whole GetFrame call
+    std::atomic<uint64_t> alloc_ns{ 0 };
+    std::atomic<uint64_t> getframe_ns{ 0 };
+    std::atomic<uint64_t> max_getframe_ns{ 0 };
+    // steady clock of the first frame start and the last frame end, the throughput is frames / (last_end_ns - first_start_ns)
+    std::atomic<uint64_t> first_start_ns{ 0 };
+    std::atomic<uint64_t> last_end_ns{ 0 };
+    std::atomic<int> in_flight{ 0 };
+    std::atomic<int> peak_in_flight{ 0 };
+    // latency=1: the lookups of the previous frame's offsets that waited for it to finish and that missed (the offsets were gathered again)
+    std::atomic<uint64_t> offset_waits{ 0 };
+    std::atomic<uint64_t> offset_misses{ 0 };
+    const char* isa{ "C" };
+    // the row bands per frame (parameter threads)
+    int bands{ 1 };
+    int latency{ 0 };
+    bool enabled{ false };
+
+    // Called when a frame starts, add_frame ends it.
+    void begin_frame() noexcept;
+    void add_frame(const uint64_t convert, const uint64_t compute, const uint64_t correct) noexcept;
+    void add_scratch(const uint64_t bytes) noexcept;
+    // alloc: the output frame (in place: the copy of shared planes), getframe: from the call to the return of the frame.
+    void add_host(const uint64_t alloc, const uint64_t getframe) noexcept;
+    void add_offset_lookup(const bool waited, const bool missed) noexcept;
+    // Prints the summary to stderr or, when GRAYWORLD_DEBUG_FILE is set, appends it as a JSON line to that file.
+    // The occupancy is the time spent in the passes divided by the wall time times the peak number of frames in flight
+    // (below 1: the frames in flight also waited for the source or the host).
+    void dump() const noexcept;
+};
+
+// True when the GRAYWORLD_DEBUG environment variable is set to a non-zero value.
+bool grayworld_debug_env() noexcept;
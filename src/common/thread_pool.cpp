@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "thread_pool.h"
+
+static int env_int(const char* name, const int fallback) noexcept
+{
+    if (const char* v{ std::getenv(name) }; v && *v)
+    {
+        char* end;
+        const long n{ std::strtol(v, &end, 10) };
+
+        if (*end == '\0' && n > 0 && n <= 1024)
+            return static_cast<int>(n);
+    }
+
+    return fallback;
+}
+
+static void pin_thread(std::thread& t, const int cpu) noexcept
+{
+#if defined(_WIN32)
+    if (cpu < 64)
+        SetThreadAffinityMask(t.native_handle(), DWORD_PTR{ 1 } << cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#else
+    static_cast<void>(t);
+    static_cast<void>(cpu);
+#endif
+}
+
+thread_pool& thread_pool::shared() noexcept
+{
+    // never destroyed, joining the workers while the plugin is unloaded can deadlock (Windows loader lock)
+    static thread_pool* const pool{ new thread_pool(env_int("GRAYWORLD_THREADS", std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
+        env_int("GRAYWORLD_AFFINITY", 0) == 1) };
+
+    return *pool;
+}
+
+thread_pool::thread_pool(const int threads, const bool affinity) : next_queue(0), pending(0)
+{
+    const int ncpu{ std::max(static_cast<int>(std::thread::hardware_concurrency()), 1) };
+
+    // the calling thread is the last one
+    for (int i{ 0 }; i < threads - 1; ++i)
+        queues.emplace_back(std::make_unique<queue>());
+
+    for (int i{ 0 }; i < threads - 1; ++i)
+    {
+        try
+        {
+            workers.emplace_back(&thread_pool::worker, this, static_cast<size_t>(i));
+        }
+        catch (...)
+        {
+            // fewer workers, the tasks of the missing ones are stolen
+            break;
+        }
+
+        if (affinity)
+            pin_thread(workers.back(), i % ncpu);
+    }
+}
+
+int thread_pool::size() const noexcept
+{
+    return static_cast<int>(workers.size()) + 1;
+}
+
+bool thread_pool::pop(const size_t self, task& t) noexcept
+{
+    const size_t n{ queues.size() };
+
+    for (size_t i{ 0 }; i < n; ++i)
+    {
+        queue& q{ *queues[(self + i) % n] };
+        const std::lock_guard<std::mutex> lock{ q.mutex };
+
+        if (q.tasks.empty())
+            continue;
+
+        if (i == 0 && self < n)
+        {
+            t = q.tasks.front();
+            q.tasks.pop_front();
+        }
+        else
+        {
+            t = q.tasks.back();
+            q.tasks.pop_back();
+        }
+
+        const std::lock_guard<std::mutex> sleep_lock{ sleep_mutex };
+        --pending;
+
+        return true;
+    }
+
+    return false;
+}
+
+void thread_pool::execute(const task& t) noexcept
+{
+    job& j{ *t.owner };
+    j.fn(j.ctx, t.index);
+
+    if (j.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        // notified under the lock, the job can't go out of scope before the mutex is released
+        const std::lock_guard<std::mutex> lock{ j.mutex };
+        j.done = true;
+        j.done_cv.notify_all();
+    }
+}
+
+void thread_pool::worker(const size_t self) noexcept
+{
+    for (;;)
+    {
+        task t;
+
+        if (pop(self, t))
+        {
+            execute(t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock{ sleep_mutex };
+        sleep_cv.wait(lock, [this] { return pending > 0; });
+    }
+}
+
+void thread_pool::run(const int count, void (*fn)(void* ctx, const int i), void* ctx) noexcept
+{
+    if (count <= 0)
+        return;
+
+    if (count == 1 || queues.empty())
+    {
+        for (int i{ 0 }; i < count; ++i)
+            fn(ctx, i);
+
+        return;
+    }
+
+    job j{ fn, ctx, count, {}, {}, false };
+
+    // the tasks are spread over the queues, starting with a different one for every job
+    const size_t n{ queues.size() };
+    const size_t first{ next_queue.fetch_add(1, std::memory_order_relaxed) };
+
+    for (int i{ 0 }; i < count; ++i)
+    {
+        queue& q{ *queues[(first + i) % n] };
+        const std::lock_guard<std::mutex> lock{ q.mutex };
+        q.tasks.push_back({ &j, i });
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock{ sleep_mutex };
+        pending += count;
+    }
+    sleep_cv.notify_all();
+
+    // the calling thread steals until its job is done
+    while (j.remaining.load(std::memory_order_acquire) > 0)
+    {
+        task t;
+
+        if (!pop(n, t))
+            break;
+
+        execute(t);
+    }
+
+    std::unique_lock<std::mutex> lock{ j.mutex };
+    j.done_cv.wait(lock, [&j] { return j.done; });
+}
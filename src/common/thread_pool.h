@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Process-wide work-stealing pool that all filter instances share for the row bands of their frames.
+// It is created by the first instance that needs it and never destroyed (the workers end with the process).
+// GRAYWORLD_THREADS caps the number of threads (the calling thread included), the default is the number of logical cores.
+// GRAYWORLD_AFFINITY=1 pins worker i to logical core i.
+class thread_pool
+{
+public:
+    static thread_pool& shared() noexcept;
+
+    // The number of threads that run the tasks, the calling thread included.
+    int size() const noexcept;
+    // Runs fn(ctx, i) for i in 0..count-1 and returns when all are done. The calling thread runs tasks too.
+    void run(const int count, void (*fn)(void* ctx, const int i), void* ctx) noexcept;
+
+private:
+    struct job
+    {
+        void (*fn)(void* ctx, const int i);
+        void* ctx;
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        bool done;
+    };
+
+    struct task
+    {
+        job* owner;
+        int index;
+    };
+
+    // Every worker pops the front of its own queue and steals from the back of the others.
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    thread_pool(const int threads, const bool affinity);
+
+    bool pop(const size_t self, task& t) noexcept;
+    void execute(const task& t) noexcept;
+    void worker(const size_t self) noexcept;
+
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next_queue;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    int pending;
+};
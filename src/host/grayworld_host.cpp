@@ -0,0 +1,706 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include <VapourSynth4.h>
+
+using namespace std::literals;
+
+// A stand-in VapourSynth core: just enough of the API to create the filter and request its frames.
+// The source is a cached clip of synthetic frames (8 distinct ones), the frame context holds the requested frames until the request returns.
+
+static constexpr char usage[]{
+    "Usage: grayworld-host [options] module [name=value ...]\n"
+    "  Loads module, creates grwrld.grayworld with the integer arguments name=value and requests its frames\n"
+    "  with 1, 2, 4 .. threads threads. Every output is compared with the output of one thread.\n"
+    "  --format rgbs|yuv420|yuv444  RGB 32-bit float or 10-bit YUV (default: rgbs)\n"
+    "  --width n --height n         frame size (default: 1920x1080)\n"
+    "  --frames n                   frames of the clip, requested once per run (default: 120)\n"
+    "  --threads n                  the largest number of host threads (default: the logical cores)\n"
+};
+
+struct VSMap
+{
+    std::map<std::string, int64_t> ints;
+    std::map<std::string, double> floats;
+    std::map<std::string, VSNode*> nodes;
+    std::string error;
+};
+
+struct host_plane
+{
+    std::shared_ptr<uint8_t> data;
+    ptrdiff_t stride;
+};
+
+struct VSFrame
+{
+    std::atomic<int> refs{ 1 };
+    VSVideoFormat format;
+    int width;
+    int height;
+    host_plane planes[3];
+    VSMap props;
+};
+
+struct VSNode
+{
+    std::atomic<int> refs{ 1 };
+    VSVideoInfo vi;
+    // the source clip: a few cached frames that repeat
+    std::vector<const VSFrame*> frames;
+    // the filter
+    VSFilterGetFrame get_frame{ nullptr };
+    VSFilterFree free{ nullptr };
+    void* instance_data{ nullptr };
+};
+
+struct VSFrameContext
+{
+    // the source frames requested in arInitial, released when the request returns
+    std::vector<std::pair<int, const VSFrame*>> frames;
+    std::string error;
+};
+
+struct VSCore
+{
+};
+
+struct VSPlugin
+{
+    std::string ns;
+    VSPublicFunction create{ nullptr };
+    void* function_data{ nullptr };
+};
+
+static VSAPI api{};
+static VSPLUGINAPI plugin_api{};
+static VSCore host_core;
+// the planes that getWritePtr copied because another frame still referenced them
+static std::atomic<uint64_t> plane_copies{ 0 };
+
+static VSFrame* VS_CC host_new_video_frame(const VSVideoFormat* format, int width, int height, const VSFrame* propSrc, VSCore*)
+{
+    VSFrame* f{ new VSFrame };
+    f->format = *format;
+    f->width = width;
+    f->height = height;
+
+    for (int p{ 0 }; p < format->numPlanes; ++p)
+    {
+        const int w{ (p) ? width >> format->subSamplingW : width };
+        const int h{ (p) ? height >> format->subSamplingH : height };
+        // the strides of VapourSynth are aligned to 64 bytes
+        const ptrdiff_t stride{ (static_cast<ptrdiff_t>(w) * format->bytesPerSample + 63) & ~ptrdiff_t{ 63 } };
+        uint8_t* data{ static_cast<uint8_t*>(::operator new[](stride * h, std::align_val_t{ 64 })) };
+
+        f->planes[p] = { std::shared_ptr<uint8_t>(data, [](uint8_t* ptr) { ::operator delete[](ptr, std::align_val_t{ 64 }); }), stride };
+    }
+
+    if (propSrc)
+        f->props = propSrc->props;
+
+    return f;
+}
+
+static VSFrame* VS_CC host_copy_frame(const VSFrame* f, VSCore*)
+{
+    // the planes are shared until they are written
+    VSFrame* copy{ new VSFrame };
+    copy->format = f->format;
+    copy->width = f->width;
+    copy->height = f->height;
+    copy->props = f->props;
+
+    for (int p{ 0 }; p < 3; ++p)
+        copy->planes[p] = f->planes[p];
+
+    return copy;
+}
+
+static const VSFrame* VS_CC host_add_frame_ref(const VSFrame* f)
+{
+    const_cast<VSFrame*>(f)->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return f;
+}
+
+static void VS_CC host_free_frame(const VSFrame* f)
+{
+    if (f && const_cast<VSFrame*>(f)->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete f;
+}
+
+static void VS_CC host_free_node(VSNode* node)
+{
+    if (!node || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    if (node->free)
+        node->free(node->instance_data, &host_core, &api);
+
+    for (const VSFrame* f : node->frames)
+        host_free_frame(f);
+
+    delete node;
+}
+
+static ptrdiff_t VS_CC host_get_stride(const VSFrame* f, int plane)
+{
+    return f->planes[plane].stride;
+}
+
+static const uint8_t* VS_CC host_get_read_ptr(const VSFrame* f, int plane)
+{
+    return f->planes[plane].data.get();
+}
+
+static uint8_t* VS_CC host_get_write_ptr(VSFrame* f, int plane)
+{
+    host_plane& p{ f->planes[plane] };
+
+    // copy on write as VapourSynth does
+    if (p.data.use_count() > 1)
+    {
+        const int h{ (plane) ? f->height >> f->format.subSamplingH : f->height };
+        uint8_t* data{ static_cast<uint8_t*>(::operator new[](p.stride * h, std::align_val_t{ 64 })) };
+        std::memcpy(data, p.data.get(), p.stride * h);
+
+        p.data = std::shared_ptr<uint8_t>(data, [](uint8_t* ptr) { ::operator delete[](ptr, std::align_val_t{ 64 }); });
+        plane_copies.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return p.data.get();
+}
+
+static int VS_CC host_get_frame_width(const VSFrame* f, int plane)
+{
+    return (plane) ? f->width >> f->format.subSamplingW : f->width;
+}
+
+static int VS_CC host_get_frame_height(const VSFrame* f, int plane)
+{
+    return (plane) ? f->height >> f->format.subSamplingH : f->height;
+}
+
+static const VSMap* VS_CC host_get_frame_properties_ro(const VSFrame* f)
+{
+    return &f->props;
+}
+
+static VSMap* VS_CC host_get_frame_properties_rw(VSFrame* f)
+{
+    return &f->props;
+}
+
+static void VS_CC host_request_frame_filter(int n, VSNode* node, VSFrameContext* frameCtx)
+{
+    n = std::clamp(n, 0, node->vi.numFrames - 1);
+
+    for (const auto& f : frameCtx->frames)
+    {
+        if (f.first == n)
+            return;
+    }
+
+    // the source frames are always ready, they come from the cache of the source node
+    frameCtx->frames.emplace_back(n, host_add_frame_ref(node->frames[n % node->frames.size()]));
+}
+
+static const VSFrame* VS_CC host_get_frame_filter(int n, VSNode* node, VSFrameContext* frameCtx)
+{
+    n = std::clamp(n, 0, node->vi.numFrames - 1);
+
+    for (const auto& f : frameCtx->frames)
+    {
+        if (f.first == n)
+            return host_add_frame_ref(f.second);
+    }
+
+    return nullptr;
+}
+
+static const VSVideoInfo* VS_CC host_get_video_info(VSNode* node)
+{
+    return &node->vi;
+}
+
+static VSNode* VS_CC host_map_get_node(const VSMap* map, const char* key, int, int* error)
+{
+    const auto it{ map->nodes.find(key) };
+    if (error)
+        *error = (it == map->nodes.end());
+    if (it == map->nodes.end())
+        return nullptr;
+
+    it->second->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return it->second;
+}
+
+static int64_t VS_CC host_map_get_int(const VSMap* map, const char* key, int, int* error)
+{
+    const auto it{ map->ints.find(key) };
+    if (error)
+        *error = (it == map->ints.end());
+
+    return (it == map->ints.end()) ? 0 : it->second;
+}
+
+static int VS_CC host_map_get_int_saturated(const VSMap* map, const char* key, int index, int* error)
+{
+    return static_cast<int>(std::clamp<int64_t>(host_map_get_int(map, key, index, error), INT32_MIN, INT32_MAX));
+}
+
+static double VS_CC host_map_get_float(const VSMap* map, const char* key, int, int* error)
+{
+    const auto it{ map->floats.find(key) };
+    if (error)
+        *error = (it == map->floats.end());
+
+    return (it == map->floats.end()) ? 0.0 : it->second;
+}
+
+static int VS_CC host_map_set_int(VSMap* map, const char* key, int64_t i, int)
+{
+    map->ints[key] = i;
+
+    return 0;
+}
+
+static int VS_CC host_map_set_float(VSMap* map, const char* key, double d, int)
+{
+    map->floats[key] = d;
+
+    return 0;
+}
+
+static void VS_CC host_map_set_error(VSMap* map, const char* errorMessage)
+{
+    map->error = errorMessage;
+}
+
+static void VS_CC host_set_filter_error(const char* errorMessage, VSFrameContext* frameCtx)
+{
+    frameCtx->error = errorMessage;
+}
+
+static void VS_CC host_create_video_filter(VSMap* out, const char*, const VSVideoInfo* vi, VSFilterGetFrame getFrame, VSFilterFree free, int, const VSFilterDependency*, int,
+    void* instanceData, VSCore*)
+{
+    VSNode* node{ new VSNode };
+    node->vi = *vi;
+    node->get_frame = getFrame;
+    node->free = free;
+    node->instance_data = instanceData;
+
+    out->nodes["clip"] = node;
+}
+
+static int VS_CC host_config_plugin(const char*, const char* pluginNamespace, const char*, int, int, int, VSPlugin* plugin)
+{
+    plugin->ns = pluginNamespace;
+
+    return 1;
+}
+
+static int VS_CC host_register_function(const char* name, const char*, const char*, VSPublicFunction argsFunc, void* functionData, VSPlugin* plugin)
+{
+    if (!std::strcmp(name, "grayworld"))
+    {
+        plugin->create = argsFunc;
+        plugin->function_data = functionData;
+    }
+
+    return 1;
+}
+
+static void init_api() noexcept
+{
+    api.createVideoFilter = host_create_video_filter;
+    api.newVideoFrame = host_new_video_frame;
+    api.copyFrame = host_copy_frame;
+    api.addFrameRef = host_add_frame_ref;
+    api.freeFrame = host_free_frame;
+    api.freeNode = host_free_node;
+    api.getStride = host_get_stride;
+    api.getReadPtr = host_get_read_ptr;
+    api.getWritePtr = host_get_write_ptr;
+    api.getFrameWidth = host_get_frame_width;
+    api.getFrameHeight = host_get_frame_height;
+    api.getFramePropertiesRO = host_get_frame_properties_ro;
+    api.getFramePropertiesRW = host_get_frame_properties_rw;
+    api.requestFrameFilter = host_request_frame_filter;
+    api.getFrameFilter = host_get_frame_filter;
+    api.getVideoInfo = host_get_video_info;
+    api.mapGetNode = host_map_get_node;
+    api.mapGetInt = host_map_get_int;
+    api.mapGetIntSaturated = host_map_get_int_saturated;
+    api.mapGetFloat = host_map_get_float;
+    api.mapSetInt = host_map_set_int;
+    api.mapSetFloat = host_map_set_float;
+    api.mapSetError = host_map_set_error;
+    api.setFilterError = host_set_filter_error;
+
+    plugin_api.configPlugin = host_config_plugin;
+    plugin_api.registerFunction = host_register_function;
+}
+
+// Deterministic noise, every frame gets its own color cast.
+static uint32_t hash32(uint32_t x) noexcept
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+
+    return x;
+}
+
+static constexpr int source_frames{ 8 };
+
+static VSNode* create_source(const std::string& format, const int width, const int height, const int frames)
+{
+    VSNode* node{ new VSNode };
+    const bool yuv{ format != "rgbs" };
+    const int ss{ (format == "yuv420") ? 1 : 0 };
+
+    node->vi = { { (yuv) ? cfYUV : cfRGB, (yuv) ? stInteger : stFloat, (yuv) ? 10 : 32, (yuv) ? 2 : 4, ss, ss, 3 }, 25, 1, width, height, frames };
+
+    // the distinct frames of the source, frame n is frame n % source_frames
+    for (int n{ 0 }; n < std::min(frames, source_frames); ++n)
+    {
+        VSFrame* f{ host_new_video_frame(&node->vi.format, width, height, nullptr, &host_core) };
+
+        for (int p{ 0 }; p < 3; ++p)
+        {
+            const float cast{ 0.03f * ((n * 3 + p) % 7 - 3) };
+
+            for (int y{ 0 }; y < host_get_frame_height(f, p); ++y)
+            {
+                uint8_t* row{ f->planes[p].data.get() + y * f->planes[p].stride };
+
+                for (int x{ 0 }; x < host_get_frame_width(f, p); ++x)
+                {
+                    const float noise{ (hash32(static_cast<uint32_t>((n * 3 + p) * 0x9E3779B9u + y * 65537u + x)) & 0xFFFF) / 65535.0f };
+                    const float v{ std::clamp(0.25f + 0.5f * noise + cast, 0.0f, 1.0f) };
+
+                    if (yuv)
+                    {
+                        const uint16_t s{ static_cast<uint16_t>((p) ? 64 + (v - 0.5f) * 0.5f * 896 + 448 : 64 + v * 876) };
+                        std::memcpy(row + x * sizeof(s), &s, sizeof(s));
+                    }
+                    else
+                    {
+                        std::memcpy(row + x * sizeof(v), &v, sizeof(v));
+                    }
+                }
+            }
+        }
+
+        if (yuv)
+        {
+            f->props.ints["_ColorRange"] = 1;
+            f->props.ints["_ChromaLocation"] = 0;
+        }
+
+        node->frames.push_back(f);
+    }
+
+    return node;
+}
+
+// The hash of the planes and the offsets of an output frame.
+static uint64_t frame_hash(const VSFrame* f) noexcept
+{
+    uint64_t h{ 0xCBF29CE484222325u };
+
+    for (int p{ 0 }; p < 3; ++p)
+    {
+        const size_t row_bytes{ static_cast<size_t>(host_get_frame_width(f, p)) * f->format.bytesPerSample };
+
+        for (int y{ 0 }; y < host_get_frame_height(f, p); ++y)
+        {
+            const uint8_t* row{ f->planes[p].data.get() + y * f->planes[p].stride };
+
+            for (size_t x{ 0 }; x + 8 <= row_bytes; x += 8)
+            {
+                uint64_t v;
+                std::memcpy(&v, row + x, 8);
+                h = (h ^ v) * 0x100000001B3u;
+            }
+            for (size_t x{ row_bytes & ~size_t{ 7 } }; x < row_bytes; ++x)
+                h = (h ^ row[x]) * 0x100000001B3u;
+        }
+    }
+
+    for (const char* key : { "GrayworldA", "GrayworldB" })
+    {
+        const auto it{ f->props.floats.find(key) };
+        uint64_t v{ 0 };
+        if (it != f->props.floats.end())
+            std::memcpy(&v, &it->second, 8);
+        h = (h ^ v) * 0x100000001B3u;
+    }
+
+    return h;
+}
+
+// Requests frame n of the filter as the core does: arInitial, then arAllFramesReady with the requested frames.
+static const VSFrame* request_frame(VSNode* node, const int n, std::string& error)
+{
+    VSFrameContext ctx;
+    void* frame_data{ nullptr };
+
+    node->get_frame(n, arInitial, node->instance_data, &frame_data, &ctx, &host_core, &api);
+    const VSFrame* f{ node->get_frame(n, arAllFramesReady, node->instance_data, &frame_data, &ctx, &host_core, &api) };
+
+    for (const auto& requested : ctx.frames)
+        host_free_frame(requested.second);
+
+    if (!f)
+        error = (ctx.error.empty()) ? "no frame was returned."s : ctx.error;
+
+    return f;
+}
+
+struct host_run
+{
+    VSNode* filter;
+    int frames;
+    std::vector<uint64_t>& hashes;
+    bool reference;
+    std::atomic<int> next{ 0 };
+    std::atomic<int> mismatch{ -1 };
+    std::atomic<uint64_t> total_ns{ 0 };
+    std::atomic<uint64_t> max_ns{ 0 };
+    std::string error;
+    std::atomic<bool> failed{ false };
+};
+
+static void host_worker(host_run& r)
+{
+    for (int n{ r.next.fetch_add(1) }; n < r.frames && !r.failed.load(); n = r.next.fetch_add(1))
+    {
+        std::string error;
+
+        const auto t0{ std::chrono::steady_clock::now() };
+        const VSFrame* f{ request_frame(r.filter, n, error) };
+        const uint64_t ns{ static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count()) };
+
+        if (!f)
+        {
+            if (!r.failed.exchange(true))
+                r.error = "frame "s + std::to_string(n) + ": "s + error;
+            return;
+        }
+
+        r.total_ns.fetch_add(ns, std::memory_order_relaxed);
+        for (uint64_t max{ r.max_ns.load() }; ns > max && !r.max_ns.compare_exchange_weak(max, ns);)
+            ;
+
+        const uint64_t h{ frame_hash(f) };
+        host_free_frame(f);
+
+        if (r.reference)
+        {
+            r.hashes[n] = h;
+        }
+        else if (h != r.hashes[n])
+        {
+            int expected{ -1 };
+            r.mismatch.compare_exchange_strong(expected, n);
+        }
+    }
+}
+
+static int run(int argc, char** argv)
+{
+    std::string format{ "rgbs" };
+    std::string module;
+    int width{ 1920 };
+    int height{ 1080 };
+    int frames{ 120 };
+    int max_threads{ static_cast<int>(std::max(std::thread::hardware_concurrency(), 1u)) };
+    VSMap in;
+
+    for (int i{ 1 }; i < argc; ++i)
+    {
+        const std::string arg{ argv[i] };
+
+        if (arg.size() > 2 && arg.compare(0, 2, "--") == 0)
+        {
+            if (i + 1 >= argc)
+                throw arg + " requires a value."s;
+
+            const std::string value{ argv[++i] };
+
+            if (arg == "--format")
+            {
+                format = value;
+                continue;
+            }
+
+            const int n{ std::atoi(value.c_str()) };
+
+            if (arg == "--width")
+                width = n;
+            else if (arg == "--height")
+                height = n;
+            else if (arg == "--frames")
+                frames = n;
+            else if (arg == "--threads")
+                max_threads = n;
+            else
+                throw "unknown option "s + arg + "."s;
+
+            continue;
+        }
+
+        if (module.empty())
+        {
+            module = arg;
+            continue;
+        }
+
+        // the filter arguments
+        const size_t eq{ arg.find('=') };
+        char* end;
+        const long long v{ (eq == std::string::npos) ? 0 : std::strtoll(arg.c_str() + eq + 1, &end, 10) };
+
+        if (eq == std::string::npos || eq == 0 || *end != '\0' || eq + 1 == arg.size())
+            throw "the filter arguments are name=integer, not "s + arg + "."s;
+
+        in.ints[arg.substr(0, eq)] = v;
+    }
+
+    if (module.empty())
+        throw "module is required."s;
+    if (format != "rgbs" && format != "yuv420" && format != "yuv444")
+        throw "format must be rgbs, yuv420 or yuv444."s;
+    if (width <= 0 || height <= 0 || frames <= 0 || max_threads <= 0)
+        throw "width, height, frames and threads must be greater than 0."s;
+    if (format == "yuv420" && ((width | height) & 1))
+        throw "yuv420 requires an even width and height."s;
+
+#if defined(_WIN32)
+    HMODULE library{ LoadLibraryA(module.c_str()) };
+    if (!library)
+        throw "failed to load "s + module + "."s;
+
+    const auto plugin_init{ reinterpret_cast<void (VS_CC*)(VSPlugin*, const VSPLUGINAPI*)>(GetProcAddress(library, "VapourSynthPluginInit2")) };
+#else
+    void* library{ dlopen(module.c_str(), RTLD_NOW | RTLD_LOCAL) };
+    if (!library)
+        throw "failed to load "s + module + ": "s + dlerror();
+
+    const auto plugin_init{ reinterpret_cast<void (VS_CC*)(VSPlugin*, const VSPLUGINAPI*)>(dlsym(library, "VapourSynthPluginInit2")) };
+#endif
+
+    if (!plugin_init)
+        throw module + " has no VapourSynthPluginInit2."s;
+
+    init_api();
+
+    VSPlugin plugin;
+    plugin_init(&plugin, &plugin_api);
+
+    if (!plugin.create)
+        throw module + " didn't register grayworld."s;
+
+    VSNode* source{ create_source(format, width, height, frames) };
+    in.nodes["clip"] = source;
+
+    VSMap out;
+    plugin.create(&in, &out, plugin.function_data, &host_core, &api);
+    // the filter holds its own reference
+    host_free_node(source);
+
+    if (!out.error.empty())
+        throw out.error;
+
+    VSNode* filter{ out.nodes["clip"] };
+    std::vector<uint64_t> hashes(frames);
+    bool failed{ false };
+    double fps1{ 0.0 };
+
+    std::fprintf(stderr, "grayworld-host: %s.grayworld, %dx%d %s, %d frames\n", plugin.ns.c_str(), width, height, format.c_str(), frames);
+    std::fprintf(stdout, "threads       fps  efficiency  latency ms  max ms  plane copies/frame\n");
+
+    for (int threads{ 1 };; threads = std::min(threads * 2, max_threads))
+    {
+        host_run r{ filter, frames, hashes, threads == 1 };
+        plane_copies.store(0);
+
+        const auto t0{ std::chrono::steady_clock::now() };
+        std::vector<std::thread> workers;
+        for (int i{ 0 }; i < threads; ++i)
+            workers.emplace_back([&r] { host_worker(r); });
+        for (std::thread& t : workers)
+            t.join();
+        const double fps{ frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() };
+
+        if (r.failed.load())
+        {
+            host_free_node(filter);
+            throw r.error;
+        }
+
+        if (r.mismatch.load() >= 0)
+        {
+            std::fprintf(stderr, "grayworld-host: threads=%d: frame %d differs from the output of one thread.\n", threads, r.mismatch.load());
+            failed = true;
+        }
+
+        if (threads == 1)
+            fps1 = fps;
+
+        std::fprintf(stdout, "%7d  %8.1f  %10.2f  %10.3f  %6.3f  %18.2f\n", threads, fps, fps / (threads * fps1), r.total_ns.load() / 1e6 / frames, r.max_ns.load() / 1e6,
+            static_cast<double>(plane_copies.load()) / frames);
+        std::fflush(stdout);
+
+        if (threads == max_threads)
+            break;
+    }
+
+    // grayworldFree prints the debug summary
+    host_free_node(filter);
+
+    return (failed) ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || !std::strcmp(argv[1], "--help") || !std::strcmp(argv[1], "-h"))
+    {
+        std::fputs(usage, stderr);
+        return (argc < 2) ? 1 : 0;
+    }
+
+    try
+    {
+        return run(argc, argv);
+    }
+    catch (const std::string& error)
+    {
+        std::fprintf(stderr, "grayworld-host: %s\n", error.c_str());
+        return 1;
+    }
+}
@@ -1,145 +1,229 @@
+#include <chrono>
+#include <numeric>
+#include <optional>
 #include <string>
 
 #include "grayworld_vs.h"
-#include "../VCL2/instrset.h"
 
 using namespace std::literals;
 
-template <grayworld_mode mode>
-static void convert_frame_c(float* __restrict tmpplab, const VSFrame* src, float* line_sum, int* line_count_pels, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept
-{
-    const float* r{ reinterpret_cast<const float*>(vsapi->getReadPtr(src, 0)) };
-    const float* g{ reinterpret_cast<const float*>(vsapi->getReadPtr(src, 1)) };
-    const float* b{ reinterpret_cast<const float*>(vsapi->getReadPtr(src, 2)) };
-
-    float rgb[3];
-    float lab[3];
+// Variable resolution clips cache the scratch of this many frame sizes.
+static constexpr size_t scratch_sizes{ 4 };
 
-    for (int y{ 0 }; y < height; ++y)
-    {
-        float* acur{ tmpplab + y * width + width * height };
-        float* bcur{ tmpplab + y * width + 2 * width * height };
-        float* lcur{ tmpplab + y * width };
+static scratch_pool::lease acquire_scratch(grayworldData* d, const int width, const int height, const int strip_height) noexcept
+{
+    return d->scratch->acquire(width, height, lab_scratch_size(d->kernels, width, (strip_height) ? strip_height * d->kernels.bands : height),
+        sizeof(float) * d->kernels.bands * row_scratch_size(d->kernels, d->input, width));
+}
 
-        if constexpr (mode == grayworld_mode::mean)
-        {
-            line_sum[y] = 0.0f;
-            line_sum[y + height] = 0.0f;
-            line_count_pels[y] = 0;
+// The YUV parameters of frame, the clip's with the _ChromaLocation and _ColorRange of the frame. False when they aren't supported.
+static bool frame_yuv(const grayworldData* d, const VSFrame* frame, const VSAPI* vsapi, grayworld_yuv& yuv) noexcept
+{
+    yuv = d->yuv;
 
-            for (int x{ 0 }; x < width; ++x)
-            {
-                rgb[0] = r[x];
-                rgb[1] = g[x];
-                rgb[2] = b[x];
+    if (d->input != grayworld_input::yuv)
+        return true;
 
-                rgb2lab_c(rgb, lab);
+    const VSMap* props{ vsapi->getFramePropertiesRO(frame) };
+    int err{ 0 };
 
-                *(lcur++) = lab[0];
-                *(acur++) = lab[1];
-                *(bcur++) = lab[2];
+    int64_t chroma_location{ vsapi->mapGetInt(props, "_ChromaLocation", 0, &err) };
+    if (err)
+        chroma_location = -1;
 
-                line_sum[y] += lab[1];
-                line_sum[y + height] += lab[2];
-                line_count_pels[y]++;
-            }
-        }
-        else
-        {
-            std::vector<float> m0;
-            m0.reserve(width);
-            std::vector<float> m1;
-            m1.reserve(width);
+    int64_t color_range{ vsapi->mapGetInt(props, "_ColorRange", 0, &err) };
+    if (err)
+        color_range = -1;
 
-            for (int x{ 0 }; x < width; ++x)
-            {
-                rgb[0] = r[x];
-                rgb[1] = g[x];
-                rgb[2] = b[x];
+    return grayworld_frame_yuv(yuv, chroma_location, color_range);
+}
 
-                rgb2lab_c(rgb, lab);
+static const VSFrame* VS_CC grayworldGetFrame(int n, int activationReason, void* instanceData, [[maybe_unused]] void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
+{
+    grayworldData* d{ static_cast<grayworldData*>(instanceData) };
 
-                *(lcur++) = lab[0];
-                *(acur++) = lab[1];
-                *(bcur++) = lab[2];
+    if (activationReason == arInitial)
+    {
+        // latency=1 needs the previous frame when its offsets are no longer (or not yet) cached
+        if (d->latency && n > 0)
+            vsapi->requestFrameFilter(n - 1, d->node, frameCtx);
 
-                m0.emplace_back(lab[1]);
-                m1.emplace_back(lab[2]);
-            }
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    }
+    else if (activationReason == arAllFramesReady)
+    {
+        const auto call_start{ std::chrono::steady_clock::now() };
 
-            const auto middleItr{ m0.begin() + m0.size() / 2 };
-            std::nth_element(m0.begin(), middleItr, m0.end());
-            line_sum[y] = (m0.size() % 2 == 0) ? ((*(std::max_element(m0.begin(), middleItr)) + *middleItr) / 2) : *middleItr;
+        const VSFrame* src{ vsapi->getFrameFilter(n, d->node, frameCtx) };
+        // the frames of variable resolution clips have their own size
+        const int width{ vsapi->getFrameWidth(src, 0) };
+        const int height{ vsapi->getFrameHeight(src, 0) };
+        const int strip_height{ frame_strip_height(width, height, d->tile) };
 
-            const auto middleItr1{ m1.begin() + m1.size() / 2 };
-            std::nth_element(m1.begin(), middleItr1, m1.end());
-            line_sum[y + height] = (m1.size() % 2 == 0) ? ((*(std::max_element(m1.begin(), middleItr1)) + *middleItr1) / 2) : *middleItr1;
+        grayworld_yuv yuv;
+        if (!frame_yuv(d, src, vsapi, yuv))
+        {
+            vsapi->setFilterError("grayworld: the _ChromaLocation or _ColorRange of the frame isn't supported.", frameCtx);
+            vsapi->freeFrame(src);
+            return nullptr;
         }
 
-        r += pitch;
-        g += pitch;
-        b += pitch;
-    }
-}
+        // latency=1: the next frame waits for the offsets of this one instead of gathering them again
+        std::optional<offset_cache::in_flight> publish;
+        if (d->latency)
+            publish.emplace(d->offsets, n);
 
-static void correct_frame_c(VSFrame* dst, float* tmpplab, std::pair<float, float>& avg, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept
-{
-    float* __restrict r{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, 0)) };
-    float* __restrict g{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, 1)) };
-    float* __restrict b{ reinterpret_cast<float*>(vsapi->getWritePtr(dst, 2)) };
+        VSFrame* dst;
 
-    float rgb[3];
-    float lab[3];
+        if (d->in_place)
+        {
+            // getWritePtr copies the planes when another reference to them still exists (a cached source)
+            dst = vsapi->copyFrame(src, core);
+            vsapi->freeFrame(src);
+            src = dst;
+        }
+        else
+            dst = vsapi->newVideoFrame(&d->vi->format, width, height, src, core);
 
-    for (int y{ 0 }; y < height; ++y)
-    {
-        float* lcur{ tmpplab + y * width };
-        float* acur{ tmpplab + y * width + width * height };
-        float* bcur{ tmpplab + y * width + 2 * width * height };
+        // the write pointers first, in place the read pointers are those of the (possibly copied) planes
+        uint8_t* dstp[3]{ vsapi->getWritePtr(dst, 0), vsapi->getWritePtr(dst, 1), vsapi->getWritePtr(dst, 2) };
+        const auto alloc_end{ std::chrono::steady_clock::now() };
+        const ptrdiff_t dst_pitch[3]{ vsapi->getStride(dst, 0), vsapi->getStride(dst, 1), vsapi->getStride(dst, 2) };
+        const uint8_t* srcp[3]{ vsapi->getReadPtr(src, 0), vsapi->getReadPtr(src, 1), vsapi->getReadPtr(src, 2) };
+        const ptrdiff_t src_pitch[3]{ vsapi->getStride(src, 0), vsapi->getStride(src, 1), vsapi->getStride(src, 2) };
 
-        for (int x{ 0 }; x < width; ++x)
+        const scratch_pool::lease scratch{ acquire_scratch(d, width, height, strip_height) };
+        if (!scratch)
         {
-            lab[0] = *lcur++;
-            lab[1] = *acur++;
-            lab[2] = *bcur++;
-
-            // subtract the average for the color channels
-            lab[1] -= avg.first;
-            lab[2] -= avg.second;
-
-            //convert back to linear rgb
-            lab2rgb_c(lab, rgb);
-            r[x] = std::clamp(rgb[0], 0.0f, 1.0f);
-            g[x] = std::clamp(rgb[1], 0.0f, 1.0f);
-            b[x] = std::clamp(rgb[2], 0.0f, 1.0f);
+            vsapi->setFilterError("grayworld: failed to allocate the scratch memory.", frameCtx);
+            vsapi->freeFrame(dst);
+            if (src != dst)
+                vsapi->freeFrame(src);
+            return nullptr;
         }
 
-        r += pitch;
-        g += pitch;
-        b += pitch;
-    }
-}
+        d->stats.add_scratch(d->scratch->bytes());
 
-static const VSFrame* VS_CC grayworldGetFrame(int n, int activationReason, void* instanceData, [[maybe_unused]] void** frameData, VSFrameContext* frameCtx, VSCore* core, const VSAPI* vsapi)
-{
-    grayworldData* d{ static_cast<grayworldData*>(instanceData) };
+        float* lab{ scratch->lab.get() };
+        float* line_sum{ scratch->line_sum.get() };
+        int* line_count_pels{ scratch->line_count_pels.get() };
+        float* rows{ scratch->rows.get() };
 
-    if (activationReason == arInitial)
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
-    else if (activationReason == arAllFramesReady)
-    {
-        const VSFrame* src{ vsapi->getFrameFilter(n, d->node, frameCtx) };
-        VSFrame* dst{ vsapi->newVideoFrame(&d->vi->format, d->vi->width, d->vi->height, src, core) };
+        grayworld_stats::frame_scope frame{ d->stats };
 
-        const ptrdiff_t stride{ vsapi->getStride(src, 0) };
-        const ptrdiff_t width{ vsapi->getFrameWidth(src, 0) };
-        const ptrdiff_t height{ vsapi->getFrameHeight(src, 0) };
+        std::pair<float, float> avg;
+        int64_t pixels;
+
+        const auto t0{ std::chrono::steady_clock::now() };
+        if (d->latency)
+        {
+            // frame n is corrected with the offsets of frame n - 1 (frame 0 with its own)
+            const int prev{ std::max(n - 1, 0) };
+            offset_cache::entry prev_offsets;
+            bool waited{ false };
 
-        d->convert(d->tmpplab.get(), src, d->line_sum.get(), d->line_count_pels.get(), stride / 4, width, height, vsapi);
-        d->avg = d->compute(d->line_sum.get(), d->line_count_pels.get(), height);
-        d->correct(dst, d->tmpplab.get(), d->avg, stride / 4, width, height, vsapi);
+            // frame 0 uses its own offsets, a lookup would wait for itself
+            const bool cached{ prev != n && d->offsets.find(prev, prev_offsets, waited) };
+            d->stats.add_offset_lookup(waited, !cached);
+
+            // random access or the previous frame started after this one, its statistics are gathered again
+            if (!cached)
+            {
+                const VSFrame* prev_src{ (prev == n) ? src : vsapi->getFrameFilter(prev, d->node, frameCtx) };
+                const uint8_t* prevp[3]{ vsapi->getReadPtr(prev_src, 0), vsapi->getReadPtr(prev_src, 1), vsapi->getReadPtr(prev_src, 2) };
+                const ptrdiff_t prev_pitch[3]{ vsapi->getStride(prev_src, 0), vsapi->getStride(prev_src, 1), vsapi->getStride(prev_src, 2) };
+                const int prev_width{ vsapi->getFrameWidth(prev_src, 0) };
+                const int prev_height{ vsapi->getFrameHeight(prev_src, 0) };
+                const int prev_strip_height{ frame_strip_height(prev_width, prev_height, d->tile) };
+
+                grayworld_yuv prev_yuv;
+                if (!frame_yuv(d, prev_src, vsapi, prev_yuv))
+                {
+                    vsapi->setFilterError("grayworld: the _ChromaLocation or _ColorRange of the frame isn't supported.", frameCtx);
+                    if (prev_src != src)
+                        vsapi->freeFrame(prev_src);
+                    vsapi->freeFrame(dst);
+                    if (src != dst)
+                        vsapi->freeFrame(src);
+                    return nullptr;
+                }
+
+                // a previous frame of another size uses the scratch of its size
+                const bool same_size{ prev_width == width && prev_height == height };
+                const scratch_pool::lease prev_scratch{ (same_size) ? scratch_pool::lease(nullptr, nullptr) : acquire_scratch(d, prev_width, prev_height, prev_strip_height) };
+
+                if (!same_size && !prev_scratch)
+                {
+                    vsapi->setFilterError("grayworld: failed to allocate the scratch memory.", frameCtx);
+                    if (prev_src != src)
+                        vsapi->freeFrame(prev_src);
+                    vsapi->freeFrame(dst);
+                    if (src != dst)
+                        vsapi->freeFrame(src);
+                    return nullptr;
+                }
+
+                float* prev_lab{ (same_size) ? lab : prev_scratch->lab.get() };
+                float* prev_line_sum{ (same_size) ? line_sum : prev_scratch->line_sum.get() };
+                int* prev_line_count_pels{ (same_size) ? line_count_pels : prev_scratch->line_count_pels.get() };
+                float* prev_rows{ (same_size) ? rows : prev_scratch->rows.get() };
+
+                convert_frame_tiled(d->kernels, d->mode, d->input, prev_yuv, prev_lab, prev_strip_height, prev_rows, prevp, prev_pitch, prev_line_sum, prev_line_count_pels,
+                    prev_width, prev_height);
+                prev_offsets = { prev, d->kernels.compute(prev_line_sum, prev_line_count_pels, prev_height),
+                    std::accumulate(prev_line_count_pels, prev_line_count_pels + prev_height, int64_t{ 0 }) };
+                d->offsets.insert(prev_offsets);
+
+                if (prev_src != src)
+                    vsapi->freeFrame(prev_src);
+            }
 
-        vsapi->freeFrame(src);
+            avg = prev_offsets.avg;
+            pixels = prev_offsets.pixels;
+        }
+        else if (strip_height)
+            convert_frame_tiled(d->kernels, d->mode, d->input, yuv, lab, strip_height, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
+        else
+            convert_frame(d->kernels, d->mode, d->input, yuv, lab, rows, srcp, src_pitch, line_sum, line_count_pels, width, height);
+        const auto t1{ std::chrono::steady_clock::now() };
+        if (!d->latency)
+        {
+            avg = d->kernels.compute(line_sum, line_count_pels, height);
+            pixels = std::accumulate(line_count_pels, line_count_pels + height, int64_t{ 0 });
+        }
+        const auto t2{ std::chrono::steady_clock::now() };
+        if (d->latency)
+            correct_frame_onepass(d->kernels, d->mode, d->input, yuv, lab, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+        else if (strip_height)
+            correct_frame_tiled(d->kernels, d->input, yuv, lab, strip_height, rows, srcp, src_pitch, dstp, dst_pitch, avg, line_sum, line_count_pels, width, height);
+        else
+            correct_frame(d->kernels, d->input, yuv, dstp, dst_pitch, lab, rows, avg, width, height);
+        const auto t3{ std::chrono::steady_clock::now() };
+        if (d->latency)
+            d->offsets.insert({ n, d->kernels.compute(line_sum, line_count_pels, height), std::accumulate(line_count_pels, line_count_pels + height, int64_t{ 0 }) });
+        const auto t4{ std::chrono::steady_clock::now() };
+
+        const int64_t convert_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count() };
+        const int64_t compute_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1 + t4 - t3).count() };
+        const int64_t correct_ns{ std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count() };
+
+        frame.end(convert_ns, compute_ns, correct_ns);
+
+        VSMap* props{ vsapi->getFramePropertiesRW(dst) };
+        vsapi->mapSetFloat(props, "GrayworldA", avg.first, maReplace);
+        vsapi->mapSetFloat(props, "GrayworldB", avg.second, maReplace);
+        vsapi->mapSetInt(props, "GrayworldPixels", pixels, maReplace);
+        vsapi->mapSetInt(props, "GrayworldConvertNs", convert_ns, maReplace);
+        vsapi->mapSetInt(props, "GrayworldComputeNs", compute_ns, maReplace);
+        vsapi->mapSetInt(props, "GrayworldCorrectNs", correct_ns, maReplace);
+
+        // the source frames are already fetched in arAllFramesReady, the time starts here
+        if (d->stats.enabled)
+            d->stats.add_host(std::chrono::duration_cast<std::chrono::nanoseconds>(alloc_end - call_start).count(),
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - call_start).count());
+
+        if (src != dst)
+            vsapi->freeFrame(src);
         return dst;
     }
 
@@ -148,6 +232,10 @@ static const VSFrame* VS_CC grayworldGetFrame(int n, int activationReason, void*
 
 static void VS_CC grayworldFree(void* instanceData, [[maybe_unused]] VSCore* core, const VSAPI* vsapi) {
     grayworldData* d{ static_cast<grayworldData*>(instanceData) };
+
+    if (d->stats.enabled)
+        d->stats.dump();
+
     vsapi->freeNode(d->node);
     delete d;
 }
@@ -162,14 +250,19 @@ static void VS_CC grayworldCreate(const VSMap* in, VSMap* out, [[maybe_unused]]
         d->vi = vsapi->getVideoInfo(d->node);
         int err{ 0 };
 
-        if (d->vi->format.colorFamily != cfRGB || d->vi->format.sampleType != stFloat || d->vi->format.bytesPerSample != 4)
-            throw "clip must be in RGB 32-bit planar format."s;
+        if (d->vi->format.colorFamily == cfRGB && d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)
+            d->input = grayworld_input::planar;
+        else if (d->vi->format.colorFamily == cfYUV && ((d->vi->format.sampleType == stInteger && d->vi->format.bitsPerSample <= 16) ||
+            (d->vi->format.sampleType == stFloat && d->vi->format.bytesPerSample == 4)))
+            d->input = grayworld_input::yuv;
+        else
+            throw "clip must be in RGB 32-bit planar format or YUV 8..16-bit/32-bit planar format."s;
 
         int64_t opt{ vsapi->mapGetInt(in, "opt", 0, &err) };
         if (err)
             opt = -1;
-        if (opt < -1 || opt > 3)
-            throw "opt must be between -1..3."s;
+        if (opt < -1 || opt > 4)
+            throw "opt must be between -1..4."s;
 
         int64_t cc{ vsapi->mapGetIntSaturated(in, "cc", 0, &err) };
         if (err)
@@ -177,72 +270,122 @@ static void VS_CC grayworldCreate(const VSMap* in, VSMap* out, [[maybe_unused]]
         if (cc < 0 || cc > 1)
             throw "cc must be either 0 or 1."s;
 
-        const int iset{ instrset_detect() };
+        int64_t matrix{ vsapi->mapGetInt(in, "matrix", 0, &err) };
+        if (err)
+            matrix = 1;
+        if (matrix != 1 && matrix != 9)
+            throw "matrix must be either 1 or 9."s;
 
-        if ((opt == -1 && iset >= 10) || opt == 3)
-        {
-            if (cc == 0)
-            {
-                d->convert = convert_frame_avx512<grayworld_mode::mean>;
-                d->compute = compute_correction<grayworld_mode::mean>;
-            }
-            else
-            {
-                d->convert = convert_frame_avx512<grayworld_mode::median>;
-                d->compute = compute_correction<grayworld_mode::median>;
-            }
+        int64_t transfer{ vsapi->mapGetInt(in, "transfer", 0, &err) };
+        if (err)
+            transfer = 1;
+        if (transfer != 1 && transfer != 6 && transfer != 14 && transfer != 15 && transfer != 16)
+            throw "transfer must be 1, 6, 14, 15 or 16."s;
 
-            d->correct = correct_frame_avx512;
-        }
-        else if ((opt == -1 && iset >= 8) || opt == 2)
+        if (d->input == grayworld_input::yuv)
         {
-            if (cc == 0)
-            {
-                d->convert = convert_frame_avx2<grayworld_mode::mean>;
-                d->compute = compute_correction<grayworld_mode::mean>;
-            }
-            else
-            {
-                d->convert = convert_frame_avx2<grayworld_mode::median>;
-                d->compute = compute_correction<grayworld_mode::median>;
-            }
-
-            d->correct = correct_frame_avx2;
+            d->yuv.kr = (matrix == 1) ? 0.2126f : 0.2627f;
+            d->yuv.kb = (matrix == 1) ? 0.0722f : 0.0593f;
+            d->yuv.transfer = (transfer == 16) ? grayworld_transfer::pq : grayworld_transfer::bt709;
+            d->yuv.ss_w = d->vi->format.subSamplingW;
+            d->yuv.ss_h = d->vi->format.subSamplingH;
+            d->yuv.bits = d->vi->format.bitsPerSample;
+
+            if (d->yuv.ss_w > 1 || d->yuv.ss_h > 1)
+                throw "YUV clip must be 4:4:4, 4:2:2 or 4:2:0."s;
         }
-        else if ((opt == -1 && iset >= 2) || opt == 1)
-        {
-            if (cc == 0)
-            {
-                d->convert = convert_frame_sse2<grayworld_mode::mean>;
-                d->compute = compute_correction<grayworld_mode::mean>;
-            }
-            else
-            {
-                d->convert = convert_frame_sse2<grayworld_mode::median>;
-                d->compute = compute_correction<grayworld_mode::median>;
-            }
 
-            d->correct = correct_frame_sse2;
-        }
-        else
+        int64_t tile{ vsapi->mapGetInt(in, "tile", 0, &err) };
+        if (err)
+            tile = 0;
+        if (tile < -1)
+            throw "tile must be greater than or equal to -1."s;
+
+        int64_t layout{ vsapi->mapGetInt(in, "layout", 0, &err) };
+        if (err)
+            layout = 0;
+        if (layout < 0 || layout > 1)
+            throw "layout must be either 0 or 1."s;
+
+        int64_t scratch_precision{ vsapi->mapGetInt(in, "scratch_precision", 0, &err) };
+        if (err)
+            scratch_precision = 0;
+        if (scratch_precision < 0 || scratch_precision > 1)
+            throw "scratch_precision must be either 0 or 1."s;
+
+        int prefetch{ vsapi->mapGetIntSaturated(in, "prefetch", 0, &err) };
+        if (err)
+            prefetch = -1;
+        if (prefetch < -1)
+            throw "prefetch must be greater than or equal to -1."s;
+
+        d->latency = vsapi->mapGetIntSaturated(in, "latency", 0, &err);
+        if (err)
+            d->latency = 0;
+        if (d->latency < 0 || d->latency > 1)
+            throw "latency must be either 0 or 1."s;
+
+        int threads{ vsapi->mapGetIntSaturated(in, "threads", 0, &err) };
+        if (err)
+            threads = 1;
+        if (threads < 0)
+            throw "threads must be greater than or equal to 0."s;
+
+        int inplace{ vsapi->mapGetIntSaturated(in, "inplace", 0, &err) };
+        if (err)
+            inplace = 0;
+        if (inplace < 0 || inplace > 1)
+            throw "inplace must be either 0 or 1."s;
+
+        const bool hugepages{ !!vsapi->mapGetInt(in, "hugepages", 0, &err) };
+        const bool stream{ !!vsapi->mapGetInt(in, "stream", 0, &err) };
+
+        const bool debug{ !!vsapi->mapGetInt(in, "debug", 0, &err) };
+        d->stats.enabled = (!err && debug) || grayworld_debug_env();
+
+        d->mode = (cc == 0) ? grayworld_mode::mean : grayworld_mode::median;
+        const grayworld_layout lab_layout{ (layout == 0) ? grayworld_layout::planar : grayworld_layout::interleaved };
+        const grayworld_precision lab_precision{ (scratch_precision == 0) ? grayworld_precision::fp32 : grayworld_precision::fp16 };
+
+        if (opt >= 0 && !grayworld_supports(grayworld_cpu_features(), static_cast<int>(opt), scratch_precision == 1))
+            throw "opt="s + std::to_string(opt) + " is not supported by the CPU."s;
+
+        d->kernels = get_kernels(grayworld_dispatch(static_cast<int>(opt), grayworld_cpu_features(), scratch_precision == 1), d->mode, d->input, lab_layout, lab_precision, stream,
+            prefetch);
+
+        // the shared pool is created by the first instance that uses it
+        if (threads != 1)
+            d->kernels.bands = (threads == 0) ? thread_pool::shared().size() : std::min(threads, thread_pool::shared().size());
+
+        d->stats.isa = d->kernels.isa;
+        d->stats.bands = d->kernels.bands;
+        d->stats.latency = d->latency;
+
+        // latency=1 always works on strips, tile=0 selects the automatic strip height
+        if (tile == 0 && d->latency)
+            tile = -1;
+
+        d->tile = static_cast<int>(std::min<int64_t>(tile, 1 << 20));
+
+        // VapourSynth can't tell whether the source is still referenced before the frame is copied, with the usual frame cache
+        // it is and copyFrame + getWritePtr copy every plane, an extra read and write of the frame compared to newVideoFrame.
+        // The strips read the chroma rows above them with vertical subsampling,
+        // latency=1 requests the previous frame too (the source is then always referenced)
+        d->in_place = inplace && (!d->tile || !d->yuv.ss_h) && !d->latency;
+
+        d->scratch = std::make_unique<scratch_cache>(scratch_sizes, hugepages);
+
+        // the scratch of variable resolution clips (width 0) is allocated by the first frame of every size
+        if (d->vi->width)
         {
-            if (cc == 0)
-            {
-                d->convert = convert_frame_c<grayworld_mode::mean>;
-                d->compute = compute_correction<grayworld_mode::mean>;
-            }
-            else
-            {
-                d->convert = convert_frame_c<grayworld_mode::median>;
-                d->compute = compute_correction<grayworld_mode::median>;
-            }
+            const int strip_height{ frame_strip_height(d->vi->width, d->vi->height, d->tile) };
 
-            d->correct = correct_frame_c;
-        }
+            // the first entry is allocated here to report the failure early
+            if (!acquire_scratch(d.get(), d->vi->width, d->vi->height, strip_height))
+                throw "failed to allocate the scratch memory."s;
 
-        d->tmpplab = std::make_unique<float[]>(d->vi->height * d->vi->width * 3);
-        d->line_count_pels = std::make_unique<int[]>(d->vi->height);
-        d->line_sum = std::make_unique<float[]>(d->vi->height * 2);
+            d->stats.add_scratch(d->scratch->bytes());
+        }
     }
     catch (const std::string& error)
     {
@@ -251,18 +394,30 @@ static void VS_CC grayworldCreate(const VSMap* in, VSMap* out, [[maybe_unused]]
         return;
     }
 
-    VSFilterDependency deps[] = { {d->node, rpStrictSpatial} };
+    VSFilterDependency deps[] = { {d->node, (d->latency) ? rpGeneral : rpStrictSpatial} };
     vsapi->createVideoFilter(out, "grayworld", d->vi, grayworldGetFrame, grayworldFree, fmParallel, deps, 1, d.get(), core);
     d.release();
 }
 
 VS_EXTERNAL_API(void) VapourSynthPluginInit2(VSPlugin* plugin, const VSPLUGINAPI* vspapi)
 {
-    vspapi->configPlugin("com.vapoursynth.grayworld", "grwrld", "A color correction based on the grayworld assumption", VS_MAKE_VERSION(1, 0), VAPOURSYNTH_API_VERSION, 0, plugin);
+    vspapi->configPlugin("com.vapoursynth.grayworld", "grwrld", "A color correction based on the grayworld assumption", VS_MAKE_VERSION(1, 1), VAPOURSYNTH_API_VERSION, 0, plugin);
     vspapi->registerFunction("grayworld",
         "clip:vnode;"
         "opt:int:opt;"
-        "cc:int:opt;",
+        "cc:int:opt;"
+        "matrix:int:opt;"
+        "transfer:int:opt;"
+        "debug:int:opt;"
+        "tile:int:opt;"
+        "layout:int:opt;"
+        "hugepages:int:opt;"
+        "scratch_precision:int:opt;"
+        "stream:int:opt;"
+        "prefetch:int:opt;"
+        "latency:int:opt;"
+        "threads:int:opt;"
+        "inplace:int:opt;",
         "clip:vnode;",
         grayworldCreate, nullptr, plugin);
 }
@@ -5,32 +5,32 @@
 #include <VapourSynth4.h>
 #include <VSHelper4.h>
 
-#include "../common/common.h"
-
-template <grayworld_mode mode>
-void convert_frame_sse2(float* __restrict tmpplab, const VSFrame* src, float* line_sum, int* line_count_pels, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-void correct_frame_sse2(VSFrame* dst, float* tmpplab, std::pair<float, float>& avg, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-
-template <grayworld_mode mode>
-void convert_frame_avx2(float* __restrict tmpplab, const VSFrame* src, float* line_sum, int* line_count_pels, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-void correct_frame_avx2(VSFrame* dst, float* tmpplab, std::pair<float, float>& avg, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-
-template <grayworld_mode mode>
-void convert_frame_avx512(float* __restrict tmpplab, const VSFrame* src, float* line_sum, int* line_count_pels, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-void correct_frame_avx512(VSFrame* dst, float* tmpplab, std::pair<float, float>& avg, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
+#include "../common/grayworld_core.h"
+#include "../common/offset_cache.h"
+#include "../common/scratch.h"
+#include "../common/stats.h"
+#include "../common/thread_pool.h"
 
 struct grayworldData
 {
     VSNode* node;
     const VSVideoInfo* vi;
 
-    std::pair<float, float> avg;
+    grayworld_mode mode;
+    grayworld_input input;
+    grayworld_yuv yuv;
+    grayworld_kernels kernels;
+    // the tile parameter, the strip height depends on the size of the frame
+    int tile;
+    int latency;
+    // the source frame is reused as the output frame
+    bool in_place;
+
+    // the offsets of the last frames for latency=1
+    offset_cache offsets;
 
-    std::unique_ptr<float[]>tmpplab;
-    std::unique_ptr<int[]>line_count_pels;
-    std::unique_ptr<float[]>line_sum;
+    // one entry per frame in flight (fmParallel) and frame size (variable resolution clips)
+    std::unique_ptr<scratch_cache> scratch;
 
-    void (*convert)(float* __restrict tmpplab, const VSFrame* src, float* line_sum, int* line_count_pels, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
-    std::pair<float, float>(*compute)(float* line_sum, int* line_count_pels, const int height) noexcept;
-    void (*correct)(VSFrame* dst, float* tmpplab, std::pair<float, float>& avg, const ptrdiff_t pitch, const int width, const int height, const VSAPI* vsapi) noexcept;
+    grayworld_stats stats;
 };